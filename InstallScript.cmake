@@ -58,6 +58,6 @@ foreach(T ${JAVA_BIN_TOOLS})
 	if(NOT MY_PREFFIX)
 		set(MY_PREFFIX ${CMAKE_INSTALL_PREFIX})
 	endif()
-	execute_process(COMMAND ln -sfv run-java-tool.bash ${T}
+	execute_process(COMMAND ln -sfv run-java-tool ${T}
 			WORKING_DIRECTORY ${MY_PREFFIX}/usr/bin)
 endforeach()
@@ -0,0 +1,55 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "snapshot.h"
+
+#define JEM_CLASSPATH_CACHE_FILE "classpath"
+
+/**
+ * Frees the process wide classpath cache
+ */
+void jemClasspathCacheClose(void);
+
+/**
+ * Get the cached classpath of a package and its dependencies, valid while
+ * none of the files and directories it was derived from changed
+ *
+ * @param name string containing the name of the package
+ * @return a string containing the value, or null if not cached. The string must be freed!
+ */
+char *jemClasspathCacheGet(const char *name);
+
+/**
+ * Cache the classpath of a package and its dependencies, dropping all cached
+ * classpaths derived from a file that changed since. The stamps of the files
+ * are the ones taken as they were read, so no file is stat'ed again here.
+ *
+ * @param name string containing the name of the package
+ * @param classpath string containing the classpath
+ * @param sources null terminated array of files and directories the classpath
+ *        was derived from
+ * @param stamps array of the stamps of the sources, taken as they were read
+ */
+void jemClasspathCachePut(const char *name,const char *classpath,char **sources,const struct jem_snapshot_stamp *stamps);
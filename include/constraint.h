@@ -0,0 +1,86 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define JEM_VERSION_PARTS 4         /** version parts kept in a version key */
+#define JEM_VERSION_PART_MAX 0xffff /** largest version part, larger saturate */
+
+/**
+ * Comparison operator of a version constraint
+ */
+enum jem_constraint_op {
+    JEM_CONSTRAINT_NONE,    /** no constraint, matches any version */
+    JEM_CONSTRAINT_EQ,      /** =, the given version parts are equal */
+    JEM_CONSTRAINT_LT,      /** < */
+    JEM_CONSTRAINT_LE,      /** <= */
+    JEM_CONSTRAINT_GT,      /** > */
+    JEM_CONSTRAINT_GE       /** >=, also a bare version or a list of atoms */
+};
+
+/**
+ * Version constraint, parsed once into a version key and a mask of the
+ * version parts it specifies
+ */
+struct jem_constraint {
+    uint64_t version;           /** version key */
+    uint64_t mask;              /** version key bits the constraint specifies */
+    enum jem_constraint_op op;  /** comparison operator */
+};
+
+/**
+ * Parse a version into a key, versions compare as their keys. Each of the
+ * first JEM_VERSION_PARTS numeric parts takes 16 bits, the first part most
+ * significant. The legacy java 1.x numbering is folded to x, so 1.8 is 8.
+ *
+ * @param version string containing the version, parsing starts at the first
+ *        digit and any non digit separates parts
+ * @param parts set to the amount of parts parsed, may be null
+ * @return the version key, 0 if there is no version
+ */
+uint64_t jemVersionKey(const char *version,unsigned int *parts);
+
+/**
+ * Parse a constraint, an optional operator followed by one or more space
+ * separated atoms such as "virtual/jre-1.6" or "icedtea-bin-7", the version
+ * of an atom starts at its first digit. A list of atoms without an operator
+ * is satisfied by the lowest of their versions or anything newer.
+ *
+ * @param constraint pointer to a constraint struct to fill in
+ * @param value string containing the constraint, or null
+ * @return true if the value has a version, false otherwise and the
+ *         constraint matches any version
+ */
+bool jemConstraintParse(struct jem_constraint *constraint,const char *value);
+
+/**
+ * Check a version key against a constraint
+ *
+ * @param constraint pointer to a constraint struct
+ * @param version the version key
+ * @return true if the version satisfies the constraint, false otherwise
+ */
+bool jemConstraintMatches(const struct jem_constraint *constraint,uint64_t version);
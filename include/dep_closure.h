@@ -0,0 +1,153 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "package.h"
+
+/**
+ * Dependency closure over all loaded packages. Each package and each other
+ * dependency name gets a dense id, dependencies of an id are a bitset.
+ */
+struct jem_dep_closure {
+    struct jem_pkg *pkgs;   /** packages, ids 0 to pkg_count-1 follow their order. Not owned! */
+    size_t pkg_count;       /** amount of packages */
+    char **names;           /** names of the ids past the packages, virtuals and missing packages */
+    size_t count;           /** amount of ids */
+    size_t words;           /** 64 bit words per bitset */
+    uint64_t *direct;       /** direct dependency bitset of each id */
+    uint64_t *closure;      /** transitive dependency bitset of each id */
+    uint64_t *rdirect;      /** direct dependent bitset of each id */
+    uint64_t *rclosure;     /** transitive dependent bitset of each id */
+    uint32_t *slots;        /** name hash slots, id + 1 or 0 */
+    size_t mask;            /** name hash slots - 1 */
+};
+
+/**
+ * Build the dependency closure of all packages. Virtual dependencies are not
+ * expanded to a provider, their provider depends on the active vm.
+ *
+ * @param pkgs an array of pkg structs, as returned by jemPkgLoadPackages()
+ * @param key the id of the variable, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @return a closure struct, or null on error. Which must be freed using
+ *         jemFreeDepClosure(), the pkgs must outlive it!
+ */
+struct jem_dep_closure *jemDepClosureNew(struct jem_pkg *pkgs,enum jem_key key);
+
+/**
+ * Build the dependency closure of all packages over several kinds of
+ * dependencies at once, along with the inverted index of dependents
+ *
+ * @param pkgs an array of pkg structs, as returned by jemPkgLoadPackages()
+ * @param keys an array of variable ids, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @param key_count amount of keys
+ * @return a closure struct, or null on error. Which must be freed using
+ *         jemFreeDepClosure(), the pkgs must outlive it!
+ */
+struct jem_dep_closure *jemDepClosureNewKeys(struct jem_pkg *pkgs,const enum jem_key *keys,size_t key_count);
+
+/**
+ * Frees the allocated memory used by a closure struct
+ *
+ * @param closure a pointer to a closure struct
+ */
+void jemFreeDepClosure(struct jem_dep_closure *closure);
+
+/**
+ * Get the id of a package or dependency name
+ *
+ * @param closure a pointer to a closure struct
+ * @param name string containing the name
+ * @return the id, or -1 if the name is neither a package nor a dependency
+ */
+long jemDepClosureId(const struct jem_dep_closure *closure,const char *name);
+
+/**
+ * Get the name of an id
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id
+ * @return a string containing the value. The string must NOT be freed!
+ */
+const char *jemDepClosureName(const struct jem_dep_closure *closure,size_t id);
+
+/**
+ * Get the transitive dependencies of a package, the bitset has
+ * closure->words words, bit id%64 of word id/64 is set for each dependency
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id of the package
+ * @return the bitset. Which must NOT be freed!
+ */
+const uint64_t *jemDepClosureGet(const struct jem_dep_closure *closure,size_t id);
+
+/**
+ * Get the transitive dependencies of a package as dep structs, in id order
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id of the package
+ * @return an array of dep structs, or null if none. Only the name and, if the
+ *         dependency is an installed package, the filename are set. Which must
+ *         be freed, including struct members!
+ */
+struct jem_dep *jemDepClosureDeps(const struct jem_dep_closure *closure,size_t id);
+
+/**
+ * Get the transitive dependencies shared by all of several packages
+ *
+ * @param closure a pointer to a closure struct
+ * @param ids an array of package ids
+ * @param count amount of ids
+ * @return an array of dep structs, or null if none. Only the name and, if the
+ *         dependency is an installed package, the filename are set. Which must
+ *         be freed, including struct members!
+ */
+struct jem_dep *jemDepClosureShared(const struct jem_dep_closure *closure,const size_t *ids,size_t count);
+
+/**
+ * Get the packages depending on an id, the bitset has closure->words words,
+ * bit id%64 of word id/64 is set for each dependent
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id of the package or dependency
+ * @param transitive include packages depending on it through other packages
+ * @return the bitset. Which must NOT be freed!
+ */
+const uint64_t *jemDepClosureGetDependents(const struct jem_dep_closure *closure,size_t id,bool transitive);
+
+/**
+ * Get the packages depending on any of several ids, excluding the ids
+ *
+ * @param closure a pointer to a closure struct
+ * @param ids an array of package or dependency ids
+ * @param count amount of ids
+ * @param transitive include packages depending on them through other packages
+ * @return an array of dep structs, or null if none. Only the name and the
+ *         filename are set. Which must be freed, including struct members!
+ */
+struct jem_dep *jemDepClosureDependents(const struct jem_dep_closure *closure,
+                                        const size_t *ids,
+                                        size_t count,
+                                        bool transitive);
@@ -0,0 +1,48 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "package.h"
+
+/**
+ * Resolve the transitive dependencies of a package. Each package becomes a
+ * single node, loaded once, nodes are in breadth first discovery order.
+ *
+ * @param params an array of param structs of the package
+ * @param key the id of the variable, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @return an array of dep structs, or null if none. Which must be freed, including struct members!
+ */
+struct jem_dep *jemDepGraphResolve(struct jem_param *params,enum jem_key key);
+
+/**
+ * Resolve the combined transitive dependencies of several packages. Shared
+ * dependencies become a single node, nodes are in breadth first discovery
+ * order, starting with the direct dependencies of each package in turn.
+ *
+ * @param params an array of param struct arrays, one for each package
+ * @param count amount of packages
+ * @param key the id of the variable, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @return an array of dep structs, or null if none. Which must be freed, including struct members!
+ */
+struct jem_dep *jemDepGraphResolveAll(struct jem_param **params,size_t count,enum jem_key key);
@@ -21,6 +21,7 @@
  *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "classpath_cache.h"
 #include "package.h"
 #include "version.h"
 #include "vm.h"
@@ -32,6 +33,8 @@ struct jem_env {
     struct jem_pkg *pkgs;       /** packages */
     struct jem_vm *vms;         /** virtual machines */
     struct jem_vm *active_vm;   /** pointer to the active vm struct in the virtual machines vms struct array */
+    struct jem_vm *lazy_vm;     /** active vm loaded alone before vms, kept until the env is freed */
+    struct jem_vm_index *vm_index;  /** index of the vms by name, file name and JAVA_HOME */
     unsigned short vm_count;    /** stores the amount of vms in the array */
 };
 
@@ -76,6 +79,15 @@ struct jem_vm *jemGetActiveVM(struct jem_env *env);
  */
 struct jem_vm **jemFindVM(char *name);
 
+/**
+ * Get a VM by number, config file name, JAVA_HOME, or VM name, an exact name
+ * or the unique prefix of one VM's name
+ *
+ * @param vm_name string containing the vm number, path or name
+ * @return a pointer to a vm struct, or null if not found. Must NOT be freed!
+ */
+struct jem_vm *jemGetVM(const char *vm_name);
+
 /**
  * Initialize env struct
  *
@@ -120,23 +132,55 @@ void jemPrintVMParams(const char *vm_name);
 void jemPrintExe(const char *exe);
 
 /**
- * Print the active VM java version
+ * Print the active VM java version, from its JAVA_HOME/release file if it has
+ * one, otherwise by executing java -version
  */
 void jemPrintJavaVersion(void);
 
 /**
- * Print one or more package classpath values from the package.env file
+ * Print one or more package classpath values from the package.env file. With
+ * dependencies, multiple packages share a single resolution of their
+ * dependencies, each classpath entry is printed once.
  *
  * @param name string containing the name(s) of the package(s), 
  *             multiple comma separated package names can be specified
  */
 void jemPrintPackageClasspath(const char *name);
 
+/**
+ * Print the installed packages of one or more base package names, highest
+ * slot first, one line per base name
+ *
+ * @param name string containing the base name(s) of the package(s), multiple
+ *        comma separated base names can be specified
+ */
+void jemPrintPackageSlots(const char *name);
+
+/**
+ * Print the installed packages depending on one or more packages or jars, one
+ * per line. Packages depending on a jar are those depending on any package
+ * that includes the jar in its classpath.
+ *
+ * @param name string containing the name(s) of the package(s) or jar(s),
+ *             multiple comma separated names can be specified
+ */
+void jemPrintReverseDeps(const char *name);
+
 /**
  * Print the active VM absolute path to tools.jar
  */
 void jemPrintToolsJar(void);
 
+/**
+ * Print the installed VM satisfying the constraints of one or more packages
+ * and all their dependencies, and make it the active VM
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified
+ * @param highest select the highest satisfying VM instead of the lowest
+ */
+void jemPrintVMFor(const char *name,bool highest);
+
 /**
  * Print one or more parameter values from the active VM config file
  *
@@ -147,11 +191,23 @@ void jemPrintValueFromActiveVM(const char *name);
 /**
  * Print one or more parameter values from one or more package.env file
  *
- * @param name string containing the name(s) of the package(s), multiple package(s) separated parameter names can be specified
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified, or JEM_PKG_ALL for all
  * @param param string containing the parameter(s) names, multiple comma separated parameter names can be specified
  */
 void jemPrintValueFromPackage(const char *name,const char *param);
 
+/**
+ * Print one or more parameter values from one or more package.env file as
+ * records of package name, parameter name and value separated by tabs, one
+ * record per line, all written at once
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified, or JEM_PKG_ALL for all
+ * @param param string containing the parameter(s) names, multiple comma separated parameter names can be specified
+ */
+void jemPrintValuesFromPackages(const char *name,const char *param);
+
 /**
  * Print providers/packages for one or more virtual package(s)
  *
@@ -160,6 +216,18 @@ void jemPrintValueFromPackage(const char *name,const char *param);
  */
 void jemPrintVirtualProviders(const char *virtual);
 
+/**
+ * Select the installed VM satisfying the VM and TARGET constraints of one or
+ * more packages and all their dependencies, including the JDK or JRE type it
+ * provides. Build only VMs and VMs whose JAVA_HOME does not exist are skipped
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified
+ * @param highest select the highest satisfying VM instead of the lowest
+ * @return a pointer to a vm struct, or null if none. Which must NOT be freed!
+ */
+struct jem_vm *jemSelectVM(const char *name,bool highest);
+
 /**
  * Set the System VM, create a symlink for the given vm
  *
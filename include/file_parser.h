@@ -23,8 +23,45 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include "output_formatter.h"
 
+/**
+ * Well known config/package.env keys, each expanded as X(NAME)
+ */
+#define JEM_KEYS(X) \
+    X(BUILD_DEPEND) \
+    X(BUILD_ONLY) \
+    X(CLASSPATH) \
+    X(DEPEND) \
+    X(DESCRIPTION) \
+    X(JAVA_HOME) \
+    X(OPTIONAL_DEPEND) \
+    X(PATH) \
+    X(PROVIDERS) \
+    X(PROVIDES) \
+    X(PROVIDES_TYPE) \
+    X(PROVIDES_VERSION) \
+    X(TARGET) \
+    X(VERSION) \
+    X(VM)
+
+/**
+ * Ids of the well known keys, JEM_KEY_<NAME>
+ */
+enum jem_key {
+#define JEM_KEY_ID(name) JEM_KEY_##name,
+    JEM_KEYS(JEM_KEY_ID)
+#undef JEM_KEY_ID
+    JEM_KEY_COUNT
+};
+
+/**
+ * Names of the well known keys, indexed by key id
+ */
+extern const char *jem_key_names[];
+
 /**
  * config/package.env file parameter
  */
@@ -34,26 +71,119 @@ struct jem_param {
 };
 
 /**
- * Frees the allocated memory in a array of param structs
+ * Frees the allocated memory in a array of param structs returned by the
+ * parser. Names and values are part of the same allocation.
  *
  * @param params a pointer to an array of param structs
  */
 void jemFreeParams(struct jem_param *params);
 
 /**
- * Returns the value of a parameter in the array of param structs
+ * Returns the value of a parameter in the array of param structs, using the
+ * hash index built by the parser. If a name occurs more than once the first
+ * value is returned.
  *
- * @param params an array of param structs
+ * @param params an array of param structs returned by the parser
  * @param name the name of the parameter
  * @return a string containing the value. The string must NOT be freed!
  */
 char *jemGetValue(struct jem_param *params,const char *name);
 
 /**
- * Parses a config/package.env file's parameters. Storing them in an dynamically
- * allocated struct array.
+ * Returns the value of a well known parameter, recorded by the parser so no
+ * name lookup is done
+ *
+ * @param params an array of param structs returned by the parser
+ * @param key the id of the parameter
+ * @return a string containing the value. The string must NOT be freed!
+ */
+char *jemGetKey(struct jem_param *params,enum jem_key key);
+
+/**
+ * Get the amount of parameters in an array of param structs
+ *
+ * @param params an array of param structs
+ * @return the amount of params, 0 if params is null
+ */
+size_t jemParamsCount(struct jem_param *params);
+
+/**
+ * Get the size of an array of param structs once packed by jemParamsPack()
+ *
+ * @param params an array of param structs returned by the parser
+ * @return the packed size in bytes, 0 if params is null
+ */
+size_t jemParamsPackedSize(struct jem_param *params);
+
+/**
+ * Pack an array of param structs into a position independent copy, used to
+ * store parsed files in the index snapshot
+ *
+ * @param params an array of param structs returned by the parser
+ * @param buf buffer of at least jemParamsPackedSize() bytes
+ */
+void jemParamsPack(struct jem_param *params,void *buf);
+
+/**
+ * Unpack a copy of an array of param structs made by jemParamsPack()
+ *
+ * @param buf the packed params
+ * @param size the packed size in bytes
+ * @return an array of param structs, or null if invalid. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParamsUnpack(const void *buf,size_t size);
+
+/**
+ * Parses a config/package.env file's parameters from a memory buffer.
+ * Storing them in a single dynamically allocated block, along with a hash
+ * index of the param names for jemGetValue().
+ *
+ * @param buf the file contents
+ * @param len the length of the file contents
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParseBuffer(const char *buf,size_t len);
+
+/**
+ * Parses an open config/package.env file's parameters. Storing them in a
+ * single dynamically allocated block. The file is memory mapped while parsing.
+ *
+ * @param fd an open file descriptor of the file, which is NOT closed
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParseFd(int fd);
+
+/**
+ * Parses a config/package.env file's parameters, relative to an open
+ * directory. Storing them in a single dynamically allocated block.
+ *
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param file the name of the file to parse, relative to dirfd
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParseFileAt(int dirfd,const char *file);
+
+/**
+ * Parses a config/package.env file's parameters. Storing them in a single
+ * dynamically allocated block. The file is memory mapped while parsing.
  *
  * @param file the name of the file to parse
- * @return an array of param structs. Which must be freed, including struct members!
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
  */
 struct jem_param *jemParseFile(const char *file);
+
+/**
+ * Get the names of all entries of an open directory, except . and .. Entries
+ * are read in large batches with getdents64.
+ *
+ * @param dirfd an open directory file descriptor, read from its current offset
+ * @param count set to the amount of names
+ * @return an array of strings, the array and strings are a single allocation,
+ *         or null on error. The array must be freed, strings must NOT be freed!
+ */
+char **jemGetDirNames(int dirfd,unsigned int *count);
@@ -0,0 +1,109 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "file_parser.h"
+
+/**
+ * A file read by a batch, filled in once the read completes
+ */
+struct jem_io_file {
+    const char *name;   /** file name, relative to the batch directory */
+    char *buf;          /** file contents, null if empty or not read */
+    size_t size;        /** size of the contents */
+    struct stat st;     /** st_mode, st_ino, st_size and st_mtim of the file */
+    int error;          /** 0 if read, otherwise the errno of the failed call */
+    bool done;          /** set once the read completed or failed */
+};
+
+/**
+ * Pending reads of a batch of files
+ */
+struct jem_io_batch;
+
+/**
+ * Check if file reads are batched through io_uring, a batch is read with
+ * plain system calls when io_uring is not built in or not available
+ *
+ * @return true if io_uring is built in and not known to be unavailable
+ */
+bool jemIoAvailable(void);
+
+/**
+ * Start reading a batch of files relative to an open directory. Each file is
+ * stat'ed, opened, read and closed. With io_uring the operations run in the
+ * kernel while the caller continues, otherwise files are read on wait.
+ *
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param files array of files to read, which must outlive the batch
+ * @param count the amount of files in the array
+ * @return a batch, or null if the files were already read. Which must be
+ *         freed using jemIoWait()!
+ */
+struct jem_io_batch *jemIoSubmit(int dirfd,struct jem_io_file *files,unsigned int count);
+
+/**
+ * Wait until a file of a batch has been read
+ *
+ * @param batch a batch returned by jemIoSubmit(), may be null
+ * @param i the index of the file in the batch's array
+ */
+void jemIoWaitFile(struct jem_io_batch *batch,unsigned int i);
+
+/**
+ * Wait until all files of a batch have been read, and free the batch
+ *
+ * @param batch a batch returned by jemIoSubmit(), may be null
+ */
+void jemIoWait(struct jem_io_batch *batch);
+
+/**
+ * Read a batch of files relative to an open directory
+ *
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param files array of files to read
+ * @param count the amount of files in the array
+ */
+void jemIoReadFiles(int dirfd,struct jem_io_file *files,unsigned int count);
+
+/**
+ * Frees the contents of an array of read files, not the array itself
+ *
+ * @param files array of files
+ * @param count the amount of files in the array
+ */
+void jemIoFreeFiles(struct jem_io_file *files,unsigned int count);
+
+/**
+ * Parses a read config/package.env file's parameters, printing an error as
+ * jemParseFile() does if the file could not be read
+ *
+ * @param file pointer to a read file
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemIoParseFile(const struct jem_io_file *file);
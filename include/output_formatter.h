@@ -49,6 +49,15 @@ struct jem_term_code {
  */
 extern struct jem_term_code jem_term_codes[];
 
+/**
+ * growable string, appended to in place, the buffer grows geometrically
+ */
+struct jem_str {
+    char *str;      /** null terminated string, null until something is appended */
+    size_t len;     /** length of the string */
+    size_t size;    /** bytes allocated */
+};
+
 /**
  * Returns the value of a code from a static array of code structs
  *
@@ -82,6 +91,78 @@ char *jemAddTermColor(char *msg);
  */
 char *jemAppendStrs(char* cur_str,char *sep_str,char *add_str);
 
+/**
+ * Make sure a string builder has room for len more characters
+ *
+ * @param str pointer to a string builder
+ * @param len the amount of characters to make room for
+ * @return true if there is room, false if out of memory
+ */
+bool jemStrReserve(struct jem_str *str,size_t len);
+
+/**
+ * Append characters to a string builder
+ *
+ * @param str pointer to a string builder
+ * @param add the characters to append
+ * @param len the amount of characters to append
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppendN(struct jem_str *str,const char *add,size_t len);
+
+/**
+ * Append a string to a string builder
+ *
+ * @param str pointer to a string builder
+ * @param add string to append, may be null
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppend(struct jem_str *str,const char *add);
+
+/**
+ * Append a string to a string builder, preceded by a separator unless the
+ * builder is empty
+ *
+ * @param str pointer to a string builder
+ * @param sep_str a non-null string separator
+ * @param add string to append, nothing is appended if null
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppendSep(struct jem_str *str,const char *sep_str,const char *add);
+
+/**
+ * Append a formatted string to a string builder, formatted in place
+ *
+ * @param str pointer to a string builder
+ * @param fmt printf format
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppendf(struct jem_str *str,const char *fmt,...) __attribute__((format(printf,2,3)));
+
+/**
+ * Remove repeated entries from a separated list in a string builder, keeping
+ * the first occurrence of each, empty entries are removed as well
+ *
+ * @param str pointer to a string builder
+ * @param sep the entry separator character
+ */
+void jemStrDedup(struct jem_str *str,char sep);
+
+/**
+ * Take the string out of a string builder, leaving it empty
+ *
+ * @param str pointer to a string builder
+ * @return the string, or null if nothing was appended. The string must be freed!
+ */
+char *jemStrDetach(struct jem_str *str);
+
+/**
+ * Frees the string of a string builder, leaving it empty
+ *
+ * @param str pointer to a string builder
+ */
+void jemStrFree(struct jem_str *str);
+
 /**
  * Adds preffix to a message that is indented by the length of the preffix
  *
@@ -98,6 +179,15 @@ char *jemIndent(const char *preffix,const char *msg);
  */
 void jemPrint(FILE *stream, char *msg);
 
+/**
+ * Print the contents of a string builder followed by a newline, with a single
+ * write and no terminal codes
+ *
+ * @param stream the stream to print to
+ * @param str pointer to a string builder, the newline is appended to it
+ */
+void jemPrintStr(FILE *stream,struct jem_str *str);
+
 /**
  * Print a message with colors and formatting
  *
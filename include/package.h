@@ -21,15 +21,33 @@
  *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#pragma once
+
+#include "constraint.h"
 #include "file_parser.h"
+#include "io_batch.h"
+#include "snapshot.h"
 
+#define JEM_PKG_ALL "*"
 #define JEM_PKG_ENV "/package.env"
 #define JEM_PKG_PATH JEM_USER_SHARE
 #define JEM_PKG_VIRTUALS "virtuals"
 #define JEM_PKG_VIRTUAL_CONFIG JEM_SYSTEM_CONFIG_PATH JEM_PKG_VIRTUALS ".conf"
 #define JEM_PKG_VIRTUAL_PATH JEM_SYSTEM_CONFIG_PATH JEM_PKG_VIRTUALS ".d/"
+#define JEM_PKG_JOBS_MAX 64
 
 extern bool jem_with_dependencies;
+extern unsigned int jem_jobs;
+
+/**
+ * package.env files read ahead of loading their packages
+ */
+struct jem_pkg_prefetch {
+    int dirfd;                  /** open JEM_PKG_PATH directory */
+    struct jem_io_file *files;  /** package.env files, relative to dirfd */
+    struct jem_io_batch *batch; /** pending reads */
+    unsigned int count;         /** amount of files */
+};
 
 /**
  * java package
@@ -38,6 +56,7 @@ struct jem_pkg {
     char *filename;         /** package.env absolute file name */
     char *name;             /** package name */
     struct jem_param *params;   /** package.env file parameters */
+    struct jem_snapshot_stamp stamp;    /** stamp of the package.env file as read */
 };
 
 /**
@@ -47,6 +66,24 @@ struct jem_dep {
     char *name;             /** package name */
     char **jars;            /** array of names */
     bool parsed_sub_deps;
+    char *filename;         /** package.env absolute file name, null if not found */
+    struct jem_param *params;   /** package.env file parameters, null if not found */
+    struct jem_snapshot_stamp stamp;    /** stamp of the package.env file as read */
+};
+
+/**
+ * virtual package, merged from virtuals.conf and its virtuals.d file
+ */
+struct jem_virtual {
+    char *name;             /** virtual name */
+    char **conf_providers;  /** virtuals.conf providers, null if not configured */
+    char **providers;       /** virtuals.d PROVIDERS, null if none */
+    struct jem_constraint vm;   /** virtuals.d VM constraint, JEM_CONSTRAINT_NONE if none */
+    bool has_file;          /** virtuals.d file exists and parsed */
+    bool resolved;          /** providers resolved, on first use */
+    bool vm_provided;       /** the active vm provides it, by the VM version */
+    const char *active;     /** active provider, "" if the vm provides it, null if none */
+    char **wanted;          /** providers of which none is installed, null otherwise */
 };
 
 /**
@@ -70,6 +107,21 @@ void jemFreePkg(struct jem_pkg *pkg);
  */
 void jemFreePkgs(struct jem_pkg *pkgs);
 
+/**
+ * Frees the process wide cache of virtual packages
+ */
+void jemFreeVirtuals(void);
+
+/**
+ * Frees the process wide cache of package jar names
+ */
+void jemFreeJarNames(void);
+
+/**
+ * Frees the process wide index of package slots
+ */
+void jemFreePkgSlots(void);
+
 /**
  * Get active package for virtual
  *
@@ -102,24 +154,15 @@ char *jemPkgGetDescription(struct jem_param *params);
 int jemPkgCmpJarNames(const void *v1, const void *v2);
 
 /**
- * Get a packages jar names
+ * Get a packages jar names. Listings are cached per process, a package's lib
+ * directory is read again only when its stamp changed.
  *
  * @param pkg_name string name of the package
- * @return a string array containing the value. The string must be freed!
+ * @return a string array containing the value, sorted. The array and strings
+ *         must NOT be freed, they remain valid until jemFreeJarNames()!
  */
 char **jemPkgGetJarNames(char *pkg_name);
 
-/**
- * Get a package's dependencies, internal function called buy wrappers
- *
- * @param params an array of param structs
- * @name string containing the variable name, DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
- * @return an array of dep structs. Which must be freed, including struct members!
- */
-struct jem_dep *_jemPkgGetDeps(struct jem_dep *deps,
-                               struct jem_param *params,
-                               char *name);
-
 /**
  * Get a package's dependencies
  *
@@ -153,6 +196,17 @@ char **jemPkgGetProvides(struct jem_param *params);
  */
 struct jem_dep *jemPkgGetOptDeps(struct jem_param *params);
 
+/**
+ * Get the installed packages of a base name
+ *
+ * @param base string base name of the package
+ * @param count pointer to store the amount of packages
+ * @return an array of package names, highest slot first, or null if none.
+ *         The array and strings must NOT be freed, they remain valid until
+ *         jemFreePkgSlots()!
+ */
+char **jemPkgGetSlots(const char *base,unsigned int *count);
+
 /**
  * Get a package's target
  *
@@ -161,6 +215,15 @@ struct jem_dep *jemPkgGetOptDeps(struct jem_param *params);
  */
 char *jemPkgGetTarget(struct jem_param *params);
 
+/**
+ * Get a virtual package from the process wide cache, virtuals.conf and all
+ * virtuals.d files are parsed once on first use
+ *
+ * @param name string containing the name of the virtual
+ * @return a pointer to a virtual struct, or null if not a virtual. Which must NOT be freed!
+ */
+const struct jem_virtual *jemPkgGetVirtual(const char *name);
+
 /**
  * Get providers/packages for one or more virtual package(s)
  *
@@ -186,7 +249,8 @@ struct jem_pkg *jemPkgLoadFile(char *filename, char *name);
 struct jem_pkg *jemPkgLoadPackage(char *name);
 
 /**
- * Loads all installed package env into a dynamically allocated pkg struct array
+ * Loads all installed package env into a dynamically allocated pkg struct array.
+ * Files are parsed by a pool of threads, unless the index snapshot is in use.
  *
  * @param virtual boolean to control loading of virtual or package.env file
  * @return an array of pkg structs. Which must be freed, including struct members!
@@ -201,6 +265,33 @@ struct jem_pkg *jemPkgLoadPackages(bool virtual);
 
 int jemPkgLoadPackagesCompare(const void *v1, const void *v2);
 
+/**
+ * Start reading the package.env files of packages ahead of loading them. Only
+ * used when reads are batched through io_uring, and the index snapshot is not.
+ *
+ * @param names array of package names
+ * @param count the amount of names
+ * @return a prefetch, or null if not in use. Which must be freed using jemPkgFreePrefetch()!
+ */
+struct jem_pkg_prefetch *jemPkgPrefetch(char **names,unsigned int count);
+
+/**
+ * Loads a installed package env, using its read ahead package.env file
+ *
+ * @param prefetch pointer to a prefetch returned by jemPkgPrefetch()
+ * @param i the index of the package in the names given to jemPkgPrefetch()
+ * @param name the name of the package
+ * @return a pkg struct. Which must be freed, including struct members!
+ */
+struct jem_pkg *jemPkgLoadPrefetched(struct jem_pkg_prefetch *prefetch,unsigned int i,char *name);
+
+/**
+ * Frees a prefetch, waiting for any pending reads
+ *
+ * @param prefetch pointer to a prefetch returned by jemPkgPrefetch(), may be null
+ */
+void jemPkgFreePrefetch(struct jem_pkg_prefetch *prefetch);
+
 /**
  * Loads a installed virtual into a dynamically allocated pkg struct
  *
@@ -208,3 +299,14 @@ int jemPkgLoadPackagesCompare(const void *v1, const void *v2);
  */
 struct jem_pkg *jemPkgLoadVirtual(char *name);
 
+/**
+ * Resolve a package name to an installed package, using the slot index. A
+ * base name resolves to its highest installed slot, base:slot and base-slot
+ * to the package of that slot, the default slot 0 has no suffix.
+ *
+ * @param name string name of the package, as base, base:slot or base-slot
+ * @return a string containing the package name, or null if not installed.
+ *         The string must NOT be freed, it remains valid until jemFreePkgSlots()!
+ */
+const char *jemPkgResolveName(const char *name);
+
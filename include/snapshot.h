@@ -0,0 +1,170 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "file_parser.h"
+
+#define JEM_CACHE_PATH "/var/cache/" JEM "/"
+#define JEM_CACHE_USER_SUFFIX ".cache/" JEM "/"
+#define JEM_SNAPSHOT_FILE "index"
+
+extern bool jem_use_cache;
+
+/**
+ * File or directory stamp, cached data is valid while its stamps match
+ */
+struct jem_snapshot_stamp {
+    int64_t mtime;          /** modification time seconds */
+    int64_t mtime_nsec;     /** modification time nanoseconds */
+    uint64_t ino;           /** inode number */
+    uint64_t size;          /** size in bytes */
+};
+
+/**
+ * Kinds of records in the index snapshot
+ */
+enum jem_snapshot_kind {
+    JEM_SNAPSHOT_PKG,       /** package.env files in JEM_PKG_PATH */
+    JEM_SNAPSHOT_VIRTUAL,   /** virtual files in JEM_PKG_VIRTUAL_PATH */
+    JEM_SNAPSHOT_VM,        /** vm files in JEM_VMS_PATH */
+    JEM_SNAPSHOT_CONFIG,    /** the JEM_PKG_VIRTUAL_CONFIG file */
+    JEM_SNAPSHOT_RELEASE,   /** JAVA_HOME/release files of the vms, missing ones included */
+    JEM_SNAPSHOT_TOOLS,     /** PATH directories of the vms, entry names as params */
+    JEM_SNAPSHOT_KINDS
+};
+
+/**
+ * Get the cache directories, the system directory first followed by the
+ * user's, or only JEM_CACHE_DIR when set in the environment
+ *
+ * @return a null terminated array of directory names ending in a /. The array
+ *         and strings must be freed!
+ */
+char **jemCacheDirs(void);
+
+/**
+ * Create a directory and any missing parents
+ *
+ * @param dir the directory name ending in a /
+ * @return true if the directory exists, false otherwise
+ */
+bool jemCacheMkdirs(const char *dir);
+
+/**
+ * Frees the process wide index snapshot, rebuilding it if a file in it was
+ * found changed
+ */
+void jemSnapshotClose(void);
+
+/**
+ * Get the amount of records of a kind in the index snapshot
+ *
+ * @param kind the kind of records
+ * @return the amount of records, 0 if no valid snapshot is available
+ */
+unsigned int jemSnapshotCount(enum jem_snapshot_kind kind);
+
+/**
+ * Get the name of a record in the index snapshot, records of a kind are
+ * sorted by name
+ *
+ * @param kind the kind of records
+ * @param i the index of the record within its kind
+ * @return a string containing the value. The string must NOT be freed!
+ */
+const char *jemSnapshotName(enum jem_snapshot_kind kind,unsigned int i);
+
+/**
+ * Check if a file exists, using the index snapshot if the file is in it.
+ * Missing release files are recorded with an empty stamp.
+ *
+ * @param filename the absolute file name
+ * @return true if the file exists, false otherwise
+ */
+bool jemSnapshotFileExists(const char *filename);
+
+/**
+ * Get the parsed copy of a config/package.env file from the index snapshot
+ *
+ * @param filename the absolute file name
+ * @param params set to an array of param structs, or null if none. Which must
+ *        be freed using jemFreeParams(), struct members must NOT be freed!
+ * @return true if the file is in the snapshot, false otherwise
+ */
+bool jemSnapshotGetParams(const char *filename,struct jem_param **params);
+
+/**
+ * Get the stamp a file had when its record in the index snapshot was written
+ *
+ * @param filename the absolute file name
+ * @param stamp pointer to a stamp struct to fill in
+ * @return true if the file is in the snapshot and unchanged, false otherwise
+ */
+bool jemSnapshotGetStamp(const char *filename,struct jem_snapshot_stamp *stamp);
+
+/**
+ * Parses a config/package.env file, using the parsed copy in the index
+ * snapshot if the file is in it
+ *
+ * @param filename the absolute file name
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemSnapshotParseFile(const char *filename);
+
+/**
+ * Fill in a stamp from a file stat
+ *
+ * @param stamp pointer to a stamp struct to fill in
+ * @param st pointer to the stat of the file
+ */
+void jemSnapshotStamp(struct jem_snapshot_stamp *stamp,const struct stat *st);
+
+/**
+ * Get the stamp of a file or directory, a missing file gets an empty stamp
+ *
+ * @param stamp pointer to a stamp struct to fill in
+ * @param file the absolute file name
+ * @return true if the file exists, false otherwise
+ */
+bool jemSnapshotStampFile(struct jem_snapshot_stamp *stamp,const char *file);
+
+/**
+ * Check a stamp against a file, a missing file matches an empty stamp
+ *
+ * @param stamp pointer to a stamp struct
+ * @param file the absolute file name
+ * @return true if the file has not changed, false otherwise
+ */
+bool jemSnapshotStampMatches(const struct jem_snapshot_stamp *stamp,const char *file);
+
+/**
+ * Rebuild the index snapshot in the first writable cache directory
+ *
+ * @return true if the snapshot was written, false otherwise
+ */
+bool jemSnapshotUpdate(void);
@@ -21,6 +21,9 @@
  *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#pragma once
+
+#include "constraint.h"
 #include "file_parser.h"
 
 #define JEM_BASE_NAME_SIZE 128
@@ -31,6 +34,10 @@
 #define JEM_USER_SHARE "/usr/share/"
 #define JEM_USER_VM_LINK_SUFFIX ".java/vm"
 #define JEM_VMS_PATH JEM_SYSTEM_CONFIG_PATH "vms.d"
+#define JEM_VM_RELEASE "release"
+
+struct jem_vm_tools;
+struct jem_vm_index;
 
 /**
  * java virtual machine
@@ -38,6 +45,10 @@
 struct jem_vm {
     char *filename;         /** config file absolute name */
     struct jem_param *params;   /** config file parameters */
+    uint64_t version;       /** PROVIDES_VERSION version key, 0 if none */
+    struct jem_vm_tools *tools; /** entries of the PATH directories, null until first used */
+    struct jem_param *release;  /** JAVA_HOME/release file parameters, null if none */
+    bool release_loaded;    /** true once the release file has been looked up */
 };
 
 /**
@@ -48,13 +59,56 @@ struct jem_vm {
 void jemFreeVMs(struct jem_vm *vms);
 
 /**
- * Get the path to an executable by name
+ * Frees a vm index
+ *
+ * @param index a pointer to a vm index, may be null
+ */
+void jemFreeVmIndex(struct jem_vm_index *index);
+
+/**
+ * Get the directories to look for executables of a VM in, its PATH, or
+ * JAVA_HOME/bin and JAVA_HOME/jre/bin if the VM config sets no PATH
  *
  * @param params an array of param structs
- * @param exec name of the executables path to get
- * @return a string containing the value. The string must be freed!
+ * @return a string containing colon separated directories, or null if none.
+ *         The string must be freed!
+ */
+char *jemVmGetToolPaths(struct jem_param *params);
+
+/**
+ * Read the entry names of a directory into params, each name with an empty
+ * value, for a hashed lookup using jemGetValue(). Entries are not checked for
+ * being executable, that is left to the one looked up.
+ *
+ * @param dir the directory name
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemVmReadTools(const char *dir);
+
+/**
+ * Get the path to an executable of a VM by name. The entries of all PATH
+ * directories are read once into a table kept with the VM, from the index
+ * snapshot when the directories are in it. Only the entry returned is checked
+ * for being an executable file, if not the next directory holding the name is.
+ *
+ * @param vm a pointer to a vm struct
+ * @param tool name of the executable to get
+ * @return a string containing the value, or null if the VM does not have the
+ *         executable. The string must be freed!
+ */
+char *jemVmGetTool(struct jem_vm *vm,const char *tool);
+
+/**
+ * Get the parameters of a VM's JAVA_HOME/release file, such as JAVA_VERSION
+ * and IMPLEMENTOR. The file is parsed once and read from the index snapshot
+ * while its stamp matches.
+ *
+ * @param vm a pointer to a vm struct
+ * @return an array of param structs, or null if the VM has no release file.
+ *         Must NOT be freed!
  */
-char *jemVmGetExec(struct jem_param *params,const char *exec);
+struct jem_param *jemVmGetRelease(struct jem_vm *vm);
 
 /**
  * Get the name of the vm
@@ -149,7 +203,8 @@ char *jemVmGetUserVMLink(void);
 
 /**
  * Get a VM by index, filename, VM name including partial match, or JAVA_HOME
- * from an array of VM structs
+ * from an array of VM structs. Builds an index each call, use jemVmIndexGet()
+ * to look up several names.
  *
  * @param vms array of vm structs
  * @param vm_count the amount of vms in the array
@@ -160,6 +215,37 @@ struct jem_vm *jemVmGetVM(struct jem_vm *vms,
                           unsigned short *vm_count,
                           const char *vm_name);
 
+/**
+ * Get a VM by number, config file name, JAVA_HOME, or VM name. A VM name
+ * matches exactly, or as the unique prefix of one VM's name, an ambiguous
+ * prefix is reported. Names are matched case insensitive.
+ *
+ * @param index a pointer to a vm index
+ * @param vm_name string containing the vm number, path or name
+ * @return a pointer to a vm struct, or null if not found. Must NOT be freed!
+ */
+struct jem_vm *jemVmIndexGet(struct jem_vm_index *index,const char *vm_name);
+
+/**
+ * Build an index of an array of vm structs
+ *
+ * @param vms array of vm structs
+ * @param vm_count the amount of vms in the array
+ * @return a pointer to a vm index, or null if out of memory. Which must be
+ *         freed using jemFreeVmIndex()!
+ */
+struct jem_vm_index *jemVmIndexNew(struct jem_vm *vms,unsigned short vm_count);
+
+/**
+ * Get the VMs whose names start with a prefix, case insensitive
+ *
+ * @param index a pointer to a vm index
+ * @param prefix the prefix of the VM names
+ * @return a null terminated array of vm pointers in vm array order, or null if
+ *         none. The array must be freed, but NOT the VM array elements!
+ */
+struct jem_vm **jemVmIndexPrefixed(struct jem_vm_index *index,const char *prefix);
+
 /**
  * Get user and system VM links
  *
@@ -176,6 +262,17 @@ char **jemVmGetVMLinks(void);
 
 int jemVmCompareVMs(const void *v1, const void *v2);
 
+/**
+ * Loads a single installed VM config file, without loading the others. The
+ * file is read directly, the index snapshot is not used, validating it costs
+ * more than parsing one file.
+ *
+ * @param name the name of the VM config file in JEM_VMS_PATH
+ * @return an array of one vm struct, or null if not installed. Which must be
+ *         freed using jemFreeVMs()!
+ */
+struct jem_vm *jemVmLoadVM(const char *name);
+
 /**
  * Loads all installed VMs config files. Storing them in an dynamically allocated
  * vm struct array.
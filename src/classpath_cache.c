@@ -0,0 +1,710 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/classpath_cache.h"
+#include "../include/package.h"
+#include "../include/vm.h"
+
+#define JEM_CLASSPATH_CACHE_MAGIC "JEMCP\t3"
+#define JEM_CLASSPATH_CACHE_SLOTS_MIN 16
+
+/**
+ * File or directory a cached classpath was derived from
+ */
+struct jem_cp_source {
+    char *path;                     /** absolute file or directory name */
+    struct jem_snapshot_stamp stamp;
+    size_t *rdeps;                  /** reverse edges, entries derived from this source, built on load */
+    size_t rdep_count;
+    int state;                      /** 0 not checked, 1 unchanged, -1 changed */
+};
+
+/**
+ * Cached classpath of a package and its dependencies
+ */
+struct jem_cp_entry {
+    char *name;                     /** package name */
+    char *classpath;
+    size_t *sources;                /** sources the classpath was derived from */
+    size_t source_count;
+    bool dropped;                   /** invalidated, not written back */
+};
+
+/**
+ * Process wide classpath cache
+ */
+struct jem_cp_cache {
+    char *dir;                      /** cache directory ending in a / */
+    char *filename;                 /** cache file name */
+    struct jem_cp_source *sources;
+    size_t source_count;
+    struct jem_cp_entry *entries;
+    size_t entry_count;
+    size_t *slots;                  /** hash index of entry names, entry index + 1 or 0 if empty */
+    size_t mask;                    /** hash index slot mask, the slot count is a power of 2 */
+    size_t *source_slots;           /** hash index of source paths, source index + 1 or 0 if empty */
+    size_t source_mask;             /** source hash index slot mask */
+    struct jem_snapshot_stamp stamp;    /** stamp of the cache file when loaded or last written */
+};
+
+static struct jem_cp_cache jem_cp_cache;
+static int jem_cp_cache_state = 0;  /** 0 not loaded, 1 loaded, -1 not available */
+
+/**
+ * Append an index to an array of indexes
+ *
+ * @return true on success, false otherwise
+ */
+static bool jemClasspathCacheAddIndex(size_t **array,size_t *count,size_t index) {
+    size_t *tmp = realloc(*array,sizeof(size_t)*(*count+1));
+    if(!tmp) {
+        jemPrintError("Unable to allocate memory to hold classpath cache"); // needs to clean up and exit under error, not just print a message
+        return(false);
+    }
+    *array = tmp;
+    (*array)[(*count)++] = index;
+    return(true);
+}
+
+/**
+ * FNV-1a hash of a package name or source path
+ */
+static uint32_t jemClasspathCacheHash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for(;*name;name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    return(hash);
+}
+
+/**
+ * Add an entry to the hash index of entry names
+ */
+static void jemClasspathCacheIndexEntry(size_t e) {
+    size_t i;
+    for(i=jemClasspathCacheHash(jem_cp_cache.entries[e].name) & jem_cp_cache.mask;
+        jem_cp_cache.slots[i];
+        i=(i+1) & jem_cp_cache.mask);
+    jem_cp_cache.slots[i] = e+1;
+}
+
+/**
+ * Add a source to the hash index of source paths
+ */
+static void jemClasspathCacheIndexSource(size_t s) {
+    size_t i;
+    for(i=jemClasspathCacheHash(jem_cp_cache.sources[s].path) & jem_cp_cache.source_mask;
+        jem_cp_cache.source_slots[i];
+        i=(i+1) & jem_cp_cache.source_mask);
+    jem_cp_cache.source_slots[i] = s+1;
+}
+
+/**
+ * Rebuild the hash index of source paths, sized for the current sources plus
+ * one
+ *
+ * @return true on success, false otherwise
+ */
+static bool jemClasspathCacheIndexSources(void) {
+    size_t slot_count = JEM_CLASSPATH_CACHE_SLOTS_MIN;
+    while(slot_count<(jem_cp_cache.source_count+1)*2)
+        slot_count *= 2;
+    size_t *slots = calloc(slot_count,sizeof(size_t));
+    if(!slots) {
+        jemPrintError("Unable to allocate memory to hold classpath cache"); // needs to clean up and exit under error, not just print a message
+        return(false);
+    }
+    free(jem_cp_cache.source_slots);
+    jem_cp_cache.source_slots = slots;
+    jem_cp_cache.source_mask = slot_count-1;
+    size_t s;
+    for(s=0;s<jem_cp_cache.source_count;s++)
+        jemClasspathCacheIndexSource(s);
+    return(true);
+}
+
+/**
+ * Find a source by path
+ *
+ * @param path the absolute file or directory name
+ * @return the source index, or the amount of sources if not found
+ */
+static size_t jemClasspathCacheFindSource(const char *path) {
+    size_t i;
+    for(i=jemClasspathCacheHash(path) & jem_cp_cache.source_mask;
+        jem_cp_cache.source_slots[i];
+        i=(i+1) & jem_cp_cache.source_mask)
+        if(strcmp(jem_cp_cache.sources[jem_cp_cache.source_slots[i]-1].path,path)==0)
+            return(jem_cp_cache.source_slots[i]-1);
+    return(jem_cp_cache.source_count);
+}
+
+/**
+ * Rebuild the hash index of entry names, sized for the current entries plus
+ * one, dropped entries are left out
+ *
+ * @return true on success, false otherwise
+ */
+static bool jemClasspathCacheIndex(void) {
+    size_t slot_count = JEM_CLASSPATH_CACHE_SLOTS_MIN;
+    while(slot_count<(jem_cp_cache.entry_count+1)*2)
+        slot_count *= 2;
+    size_t *slots = calloc(slot_count,sizeof(size_t));
+    if(!slots) {
+        jemPrintError("Unable to allocate memory to hold classpath cache"); // needs to clean up and exit under error, not just print a message
+        return(false);
+    }
+    free(jem_cp_cache.slots);
+    jem_cp_cache.slots = slots;
+    jem_cp_cache.mask = slot_count-1;
+    size_t e;
+    for(e=0;e<jem_cp_cache.entry_count;e++)
+        if(!jem_cp_cache.entries[e].dropped)
+            jemClasspathCacheIndexEntry(e);
+    return(true);
+}
+
+/**
+ * Parse a comma separated list of indexes below a limit
+ *
+ * @return true on success, false if an index is invalid
+ */
+static bool jemClasspathCacheParseIndexes(char *value,size_t limit,size_t **array,size_t *count) {
+    char *index;
+    while(value && *value && (index = strsep(&value,","))) {
+        char *end;
+        unsigned long long i = strtoull(index,&end,10);
+        if(*end || i>=limit || !jemClasspathCacheAddIndex(array,count,i))
+            return(false);
+    }
+    return(true);
+}
+
+/**
+ * Parse a tab separated stamp
+ *
+ * @return true on success, false otherwise
+ */
+static bool jemClasspathCacheParseStamp(char **cursor,struct jem_snapshot_stamp *stamp) {
+    char *fields[4];
+    int i;
+    for(i=0;i<4;i++)
+        if(!(fields[i] = strsep(cursor,"\t")))
+            return(false);
+    stamp->mtime = strtoll(fields[0],NULL,10);
+    stamp->mtime_nsec = strtoll(fields[1],NULL,10);
+    stamp->ino = strtoull(fields[2],NULL,10);
+    stamp->size = strtoull(fields[3],NULL,10);
+    return(true);
+}
+
+/**
+ * Print a tab separated stamp
+ */
+static void jemClasspathCachePrintStamp(FILE *fp,const struct jem_snapshot_stamp *stamp) {
+    fprintf(fp,"%" PRId64 "\t%" PRId64 "\t%" PRIu64 "\t%" PRIu64,
+            stamp->mtime,stamp->mtime_nsec,stamp->ino,stamp->size);
+}
+
+/**
+ * Check the virtuals stamp of the cache file, any change to virtuals.conf or
+ * virtuals.d may change how package names resolve
+ *
+ * @return true if unchanged, false otherwise
+ */
+static bool jemClasspathCacheCheckVirtuals(char **cursor) {
+    struct jem_snapshot_stamp conf;
+    struct jem_snapshot_stamp dir;
+    return(jemClasspathCacheParseStamp(cursor,&conf) &&
+           jemClasspathCacheParseStamp(cursor,&dir) &&
+           jemSnapshotStampMatches(&conf,JEM_PKG_VIRTUAL_CONFIG) &&
+           jemSnapshotStampMatches(&dir,JEM_PKG_VIRTUAL_PATH));
+}
+
+/**
+ * Free all sources and entries of the classpath cache
+ */
+static void jemClasspathCacheClear(void) {
+    size_t i;
+    for(i=0;i<jem_cp_cache.source_count;i++) {
+        free(jem_cp_cache.sources[i].path);
+        free(jem_cp_cache.sources[i].rdeps);
+    }
+    for(i=0;i<jem_cp_cache.entry_count;i++) {
+        free(jem_cp_cache.entries[i].name);
+        free(jem_cp_cache.entries[i].classpath);
+        free(jem_cp_cache.entries[i].sources);
+    }
+    free(jem_cp_cache.sources);
+    free(jem_cp_cache.entries);
+    free(jem_cp_cache.slots);
+    free(jem_cp_cache.source_slots);
+    jem_cp_cache.slots = NULL;
+    jem_cp_cache.mask = 0;
+    jem_cp_cache.source_slots = NULL;
+    jem_cp_cache.source_mask = 0;
+    jem_cp_cache.sources = NULL;
+    jem_cp_cache.source_count = 0;
+    jem_cp_cache.entries = NULL;
+    jem_cp_cache.entry_count = 0;
+}
+
+/**
+ * Parse a line of the cache file
+ *
+ * @return true on success, false if the line is invalid
+ */
+static bool jemClasspathCacheParseLine(char *line) {
+    char *cursor = line;
+    char *type = strsep(&cursor,"\t");
+    if(!cursor)
+        return(false);
+    if(strcmp(type,"V")==0)
+        return(jemClasspathCacheCheckVirtuals(&cursor));
+    if(strcmp(type,"S")==0) {
+        struct jem_cp_source *tmp = realloc(jem_cp_cache.sources,
+                                            sizeof(struct jem_cp_source)*(jem_cp_cache.source_count+1));
+        if(!tmp)
+            return(false);
+        jem_cp_cache.sources = tmp;
+        struct jem_cp_source *source = &tmp[jem_cp_cache.source_count];
+        memset(source,0,sizeof(struct jem_cp_source));
+        if(!jemClasspathCacheParseStamp(&cursor,&source->stamp))
+            return(false);
+        if(!cursor || !*cursor || !(source->path = strdup(cursor)))
+            return(false);
+        jem_cp_cache.source_count++;
+        return(true);
+    }
+    if(strcmp(type,"E")==0) {
+        struct jem_cp_entry *tmp = realloc(jem_cp_cache.entries,
+                                           sizeof(struct jem_cp_entry)*(jem_cp_cache.entry_count+1));
+        if(!tmp)
+            return(false);
+        jem_cp_cache.entries = tmp;
+        struct jem_cp_entry *entry = &tmp[jem_cp_cache.entry_count];
+        memset(entry,0,sizeof(struct jem_cp_entry));
+        char *name = strsep(&cursor,"\t");
+        char *sources = strsep(&cursor,"\t");
+        if(!sources || !cursor ||
+           !(entry->name = strdup(name)) ||
+           !(entry->classpath = strdup(cursor))) {
+            free(entry->name);
+            return(false);
+        }
+        jem_cp_cache.entry_count++;
+        if(!jemClasspathCacheParseIndexes(sources,jem_cp_cache.source_count,
+                                          &entry->sources,&entry->source_count))
+            return(false);
+        size_t s;
+        for(s=0;s<entry->source_count;s++) {
+            struct jem_cp_source *source = &jem_cp_cache.sources[entry->sources[s]];
+            if(!jemClasspathCacheAddIndex(&source->rdeps,&source->rdep_count,jem_cp_cache.entry_count-1))
+                return(false);
+        }
+        return(true);
+    }
+    return(false);
+}
+
+/**
+ * Choose the cache directory, the first writable one, creating it if needed,
+ * or else the first one with a readable cache file
+ *
+ * @param dirs a null terminated array of cache directory names
+ * @return the index of the directory, or -1 if none
+ */
+static int jemClasspathCacheChooseDir(char **dirs) {
+    int i;
+    for(i=0;dirs[i];i++)
+        if(access(dirs[i],W_OK)==0)
+            return(i);
+    for(i=0;dirs[i];i++)
+        if(jemCacheMkdirs(dirs[i]) && access(dirs[i],W_OK)==0)
+            return(i);
+    for(i=0;dirs[i];i++) {
+        char *filename = NULL;
+        asprintf(&filename,"%s%s",dirs[i],JEM_CLASSPATH_CACHE_FILE);
+        bool readable = filename && access(filename,R_OK)==0;
+        free(filename);
+        if(readable)
+            return(i);
+    }
+    return(-1);
+}
+
+/**
+ * Load the classpath cache file
+ */
+static void jemClasspathCacheLoad(void) {
+    jem_cp_cache_state = -1;
+    char **dirs = jem_use_cache ? jemCacheDirs() : NULL;
+    int dir = dirs ? jemClasspathCacheChooseDir(dirs) : -1;
+    int i;
+    for(i=0;dirs && dirs[i];i++) {
+        if(i==dir)
+            jem_cp_cache.dir = dirs[i];
+        else
+            free(dirs[i]);
+    }
+    free(dirs);
+    if(!jem_cp_cache.dir)
+        return;
+    asprintf(&jem_cp_cache.filename,"%s%s",jem_cp_cache.dir,JEM_CLASSPATH_CACHE_FILE);
+    if(!jem_cp_cache.filename)
+        return;
+    jem_cp_cache_state = 1;
+    FILE *fp = fopen(jem_cp_cache.filename,"re");
+    if(!fp) {
+        jemClasspathCacheIndex();
+        jemClasspathCacheIndexSources();
+        return;
+    }
+    flock(fileno(fp),LOCK_SH);  // appends hold LOCK_EX, never read half a line
+    struct stat st;
+    if(fstat(fileno(fp),&st)==0)
+        jemSnapshotStamp(&jem_cp_cache.stamp,&st);
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read;
+    bool valid = getline(&line,&len,fp)>0 &&
+                 strcmp(line,JEM_CLASSPATH_CACHE_MAGIC "\n")==0;
+    while(valid && (read = getline(&line,&len,fp))>0) {
+        if(line[read-1]!='\n') {    // cut short, drop it and rewrite on the next put
+            memset(&jem_cp_cache.stamp,0,sizeof(jem_cp_cache.stamp));
+            break;
+        }
+        line[read-1] = '\0';
+        valid = jemClasspathCacheParseLine(line);
+    }
+    if(!valid) {
+        jemClasspathCacheClear();
+        memset(&jem_cp_cache.stamp,0,sizeof(jem_cp_cache.stamp));  // rewrite on the next put
+    }
+    jemClasspathCacheIndex();
+    jemClasspathCacheIndexSources();
+    free(line);
+    fclose(fp);
+}
+
+/**
+ * Check a source for changes, dropping all entries derived from it if it changed
+ *
+ * @param s the source index
+ * @return true if unchanged, false otherwise
+ */
+static bool jemClasspathCacheCheck(size_t s) {
+    struct jem_cp_source *source = &jem_cp_cache.sources[s];
+    if(source->state==0) {
+        source->state = jemSnapshotStampMatches(&source->stamp,source->path) ? 1 : -1;
+        if(source->state<0) {
+            size_t r;
+            for(r=0;r<source->rdep_count;r++)
+                jem_cp_cache.entries[source->rdeps[r]].dropped = true;
+        }
+    }
+    return(source->state>0);
+}
+
+/**
+ * Print a source line of the cache file
+ */
+static void jemClasspathCachePrintSource(FILE *fp,const struct jem_cp_source *source) {
+    fprintf(fp,"S\t");
+    jemClasspathCachePrintStamp(fp,&source->stamp);
+    fprintf(fp,"\t%s\n",source->path);
+}
+
+/**
+ * Print an entry line of the cache file
+ *
+ * @param map source indexes as written to the file, or null if unchanged
+ */
+static void jemClasspathCachePrintEntry(FILE *fp,const struct jem_cp_entry *entry,const size_t *map) {
+    fprintf(fp,"E\t%s\t",entry->name);
+    size_t s;
+    for(s=0;s<entry->source_count;s++)
+        fprintf(fp,"%s%zu",(s ? "," : ""),map ? map[entry->sources[s]] : entry->sources[s]);
+    fprintf(fp,"\t%s\n",entry->classpath);
+}
+
+/**
+ * Write the classpath cache file, without dropped entries and unused sources.
+ * Source indexes in the file then differ from the ones in memory, so later
+ * puts rewrite the file instead of appending to it.
+ */
+static void jemClasspathCacheWrite(void) {
+    memset(&jem_cp_cache.stamp,0,sizeof(jem_cp_cache.stamp));
+    if(!jemCacheMkdirs(jem_cp_cache.dir))
+        return;
+    size_t *map = malloc(sizeof(size_t)*(jem_cp_cache.source_count+1));
+    size_t *uses = calloc(jem_cp_cache.source_count+1,sizeof(size_t));
+    char *tmp = NULL;
+    asprintf(&tmp,"%s%s.XXXXXX",jem_cp_cache.dir,JEM_CLASSPATH_CACHE_FILE);
+    int fd = -1;
+    if(map && uses && tmp &&
+       (fd = mkstemp(tmp))>=0) {
+        size_t e;
+        size_t s;
+        for(e=0;e<jem_cp_cache.entry_count;e++) {
+            struct jem_cp_entry *entry = &jem_cp_cache.entries[e];
+            if(entry->dropped)
+                continue;
+            for(s=0;s<entry->source_count;s++)
+                uses[entry->sources[s]]++;
+        }
+        FILE *fp = fdopen(fd,"w");
+        if(fp) {
+            struct jem_snapshot_stamp stamp;
+            fprintf(fp,"%s\nV\t",JEM_CLASSPATH_CACHE_MAGIC);
+            jemSnapshotStampFile(&stamp,JEM_PKG_VIRTUAL_CONFIG);
+            jemClasspathCachePrintStamp(fp,&stamp);
+            fprintf(fp,"\t");
+            jemSnapshotStampFile(&stamp,JEM_PKG_VIRTUAL_PATH);
+            jemClasspathCachePrintStamp(fp,&stamp);
+            fprintf(fp,"\n");
+            size_t count;
+            for(count=0,s=0;s<jem_cp_cache.source_count;s++) {
+                if(!uses[s])
+                    continue;
+                map[s] = count++;
+                jemClasspathCachePrintSource(fp,&jem_cp_cache.sources[s]);
+            }
+            for(e=0;e<jem_cp_cache.entry_count;e++) {
+                struct jem_cp_entry *entry = &jem_cp_cache.entries[e];
+                if(entry->dropped)
+                    continue;
+                jemClasspathCachePrintEntry(fp,entry,map);
+            }
+            fchmod(fd,S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            if(fclose(fp)!=0 || rename(tmp,jem_cp_cache.filename)!=0)
+                unlink(tmp);
+        } else {
+            close(fd);
+            unlink(tmp);
+        }
+    }
+    free(uses);
+    free(map);
+    free(tmp);
+}
+
+/**
+ * Append new sources and an entry to the cache file, as long as no other
+ * process changed it since it was loaded or last written
+ *
+ * @param first_source index of the first source not yet in the file
+ * @param e the index of the entry to append
+ * @return true if appended, false if the file must be rewritten
+ */
+static bool jemClasspathCacheAppend(size_t first_source,size_t e) {
+    if(!jem_cp_cache.stamp.ino)
+        return(false);
+    int fd = open(jem_cp_cache.filename,O_WRONLY|O_APPEND|O_CLOEXEC);
+    if(fd<0)
+        return(false);
+    bool appended = false;
+    struct stat st;
+    struct jem_snapshot_stamp stamp;
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *fp = open_memstream(&buf,&size);   // lines are written with a single write
+    if(fp) {
+        size_t s;
+        for(s=first_source;s<jem_cp_cache.source_count;s++)
+            jemClasspathCachePrintSource(fp,&jem_cp_cache.sources[s]);
+        jemClasspathCachePrintEntry(fp,&jem_cp_cache.entries[e],NULL);
+        fclose(fp);
+    }
+    if(buf &&
+       flock(fd,LOCK_EX)==0 &&
+       fstat(fd,&st)==0 &&
+       (jemSnapshotStamp(&stamp,&st),
+        memcmp(&stamp,&jem_cp_cache.stamp,sizeof(stamp))==0)) {
+        appended = write(fd,buf,size)==(ssize_t)size;
+        if(appended && fstat(fd,&st)==0)
+            jemSnapshotStamp(&jem_cp_cache.stamp,&st);
+        else if(!appended && ftruncate(fd,st.st_size)!=0)
+            memset(&jem_cp_cache.stamp,0,sizeof(jem_cp_cache.stamp));
+    }
+    free(buf);
+    close(fd);      // releases the lock
+    return(appended);
+}
+
+/**
+ * Find the entry of a package
+ *
+ * @param name string containing the name of the package
+ * @return a pointer to an entry, or null if not found
+ */
+static struct jem_cp_entry *jemClasspathCacheFind(const char *name) {
+    if(jem_cp_cache_state==0)
+        jemClasspathCacheLoad();
+    if(jem_cp_cache_state<=0 || !jem_cp_cache.slots)
+        return(NULL);
+    size_t i;
+    for(i=jemClasspathCacheHash(name) & jem_cp_cache.mask;
+        jem_cp_cache.slots[i];
+        i=(i+1) & jem_cp_cache.mask) {
+        struct jem_cp_entry *entry = &jem_cp_cache.entries[jem_cp_cache.slots[i]-1];
+        if(!entry->dropped && strcmp(entry->name,name)==0)
+            return(entry);
+    }
+    return(NULL);
+}
+
+/**
+ * Frees the process wide classpath cache
+ */
+void jemClasspathCacheClose(void) {
+    jemClasspathCacheClear();
+    free(jem_cp_cache.dir);
+    free(jem_cp_cache.filename);
+    jem_cp_cache.dir = NULL;
+    jem_cp_cache.filename = NULL;
+    jem_cp_cache_state = 0;
+}
+
+/**
+ * Get the cached classpath of a package and its dependencies, valid while
+ * none of the files and directories it was derived from changed
+ *
+ * @param name string containing the name of the package
+ * @return a string containing the value, or null if not cached. The string must be freed!
+ */
+char *jemClasspathCacheGet(const char *name) {
+    struct jem_cp_entry *entry = jemClasspathCacheFind(name);
+    if(!entry)
+        return(NULL);
+    size_t s;
+    for(s=0;s<entry->source_count;s++)
+        if(!jemClasspathCacheCheck(entry->sources[s]))
+            return(NULL);
+    return(strdup(entry->classpath));
+}
+
+/**
+ * Cache the classpath of a package and its dependencies, dropping all cached
+ * classpaths derived from a file that changed since. The stamps of the files
+ * are the ones taken as they were read, so no file is stat'ed again here.
+ *
+ * @param name string containing the name of the package
+ * @param classpath string containing the classpath
+ * @param sources null terminated array of files and directories the classpath
+ *        was derived from
+ * @param stamps array of the stamps of the sources, taken as they were read
+ */
+void jemClasspathCachePut(const char *name,const char *classpath,char **sources,const struct jem_snapshot_stamp *stamps) {
+    struct jem_cp_entry *entry = jemClasspathCacheFind(name);
+    if(jem_cp_cache_state<=0 || !jem_cp_cache.source_slots)
+        return;
+    bool rewrite = false;   // an entry or source stamp was replaced
+    if(entry) {
+        entry->dropped = true;
+        rewrite = true;
+    }
+    size_t first_source = jem_cp_cache.source_count;
+    struct jem_cp_entry *tmp = realloc(jem_cp_cache.entries,
+                                       sizeof(struct jem_cp_entry)*(jem_cp_cache.entry_count+1));
+    if(!tmp) {
+        jemPrintError("Unable to allocate memory to hold classpath cache"); // needs to clean up and exit under error, not just print a message
+        return;
+    }
+    jem_cp_cache.entries = tmp;
+    size_t e = jem_cp_cache.entry_count;
+    entry = &tmp[e];
+    memset(entry,0,sizeof(struct jem_cp_entry));
+    entry->name = strdup(name);
+    entry->classpath = strdup(classpath);
+    jem_cp_cache.entry_count++;
+    if(!entry->name || !entry->classpath) {
+        entry->dropped = true;
+        return;
+    }
+    int i;
+    for(i=0;sources[i];i++) {
+        size_t s = jemClasspathCacheFindSource(sources[i]);
+        if(s<jem_cp_cache.source_count) {
+            struct jem_cp_source *source = &jem_cp_cache.sources[s];
+            if(memcmp(&source->stamp,&stamps[i],sizeof(stamps[i]))) { // derived from another version
+                size_t r;
+                for(r=0;r<source->rdep_count;r++)
+                    jem_cp_cache.entries[source->rdeps[r]].dropped = true;
+                source->stamp = stamps[i];
+                source->rdep_count = 0;
+                rewrite = true;
+            }
+            source->state = 1;
+            size_t j;
+            for(j=0;j<entry->source_count && entry->sources[j]!=s;j++);
+            if(j<entry->source_count)
+                continue;
+        } else {
+            struct jem_cp_source *ntmp = realloc(jem_cp_cache.sources,
+                                                 sizeof(struct jem_cp_source)*(s+1));
+            if(!ntmp) {
+                jemPrintError("Unable to allocate memory to hold classpath cache"); // needs to clean up and exit under error, not just print a message
+                entry->dropped = true;
+                return;
+            }
+            jem_cp_cache.sources = ntmp;
+            memset(&ntmp[s],0,sizeof(struct jem_cp_source));
+            ntmp[s].path = strdup(sources[i]);
+            ntmp[s].state = 1;
+            ntmp[s].stamp = stamps[i];
+            if(!ntmp[s].path) {
+                entry->dropped = true;
+                return;
+            }
+            jem_cp_cache.source_count++;
+            if(jem_cp_cache.source_count*2>jem_cp_cache.source_mask+1) {
+                if(!jemClasspathCacheIndexSources()) {
+                    entry->dropped = true;
+                    return;
+                }
+            } else
+                jemClasspathCacheIndexSource(s);
+        }
+        if(!jemClasspathCacheAddIndex(&entry->sources,&entry->source_count,s) ||
+           !jemClasspathCacheAddIndex(&jem_cp_cache.sources[s].rdeps,&jem_cp_cache.sources[s].rdep_count,e)) {
+            entry->dropped = true;
+            return;
+        }
+    }
+    if(jem_cp_cache.entry_count*2>jem_cp_cache.mask+1) {
+        if(!jemClasspathCacheIndex())
+            return;
+    } else
+        jemClasspathCacheIndexEntry(e);
+    if(rewrite || !jemClasspathCacheAppend(first_source,e))
+        jemClasspathCacheWrite();
+}
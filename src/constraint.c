@@ -0,0 +1,149 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/constraint.h"
+
+/**
+ * Parse a version into a key, versions compare as their keys. Each of the
+ * first JEM_VERSION_PARTS numeric parts takes 16 bits, the first part most
+ * significant. The legacy java 1.x numbering is folded to x, so 1.8 is 8.
+ *
+ * @param version string containing the version, parsing starts at the first
+ *        digit and any non digit separates parts
+ * @param parts set to the amount of parts parsed, may be null
+ * @return the version key, 0 if there is no version
+ */
+uint64_t jemVersionKey(const char *version,unsigned int *parts) {
+    uint32_t part[JEM_VERSION_PARTS+1];
+    unsigned int count = 0;
+    while(version && *version && !isdigit((unsigned char)*version))
+        version++;
+    while(version && isdigit((unsigned char)*version) && count<JEM_VERSION_PARTS+1) {
+        uint32_t value = 0;
+        for(;isdigit((unsigned char)*version);version++)
+            if(value<JEM_VERSION_PART_MAX)
+                value = value*10+(*version-'0');
+        part[count++] = value<JEM_VERSION_PART_MAX ? value : JEM_VERSION_PART_MAX;
+        if(*version && !isdigit((unsigned char)version[1]))
+            break;      // a separator must be followed by a digit
+        if(*version)
+            version++;
+    }
+    unsigned int first = 0;
+    if(count>1 && part[0]==1 && part[1])   // 1.8 is java 8
+        first = 1;
+    uint64_t key = 0;
+    unsigned int i;
+    for(i=0;i<JEM_VERSION_PARTS;i++) {
+        key <<= 16;
+        if(first+i<count)
+            key |= part[first+i];
+    }
+    if(parts)
+        *parts = count-first<JEM_VERSION_PARTS ? count-first : JEM_VERSION_PARTS;
+    return(key);
+}
+
+/**
+ * Parse a constraint, an optional operator followed by one or more space
+ * separated atoms such as "virtual/jre-1.6" or "icedtea-bin-7", the version
+ * of an atom starts at its first digit. A list of atoms without an operator
+ * is satisfied by the lowest of their versions or anything newer.
+ *
+ * @param constraint pointer to a constraint struct to fill in
+ * @param value string containing the constraint, or null
+ * @return true if the value has a version, false otherwise and the
+ *         constraint matches any version
+ */
+bool jemConstraintParse(struct jem_constraint *constraint,const char *value) {
+    memset(constraint,0,sizeof(struct jem_constraint));
+    if(!value)
+        return(false);
+    while(isspace((unsigned char)*value))
+        value++;
+    enum jem_constraint_op op = JEM_CONSTRAINT_GE;
+    if(!strncmp(value,">=",2))
+        value += 2;
+    else if(!strncmp(value,"<=",2)) {
+        op = JEM_CONSTRAINT_LE;
+        value += 2;
+    } else if(*value=='>') {
+        op = JEM_CONSTRAINT_GT;
+        value++;
+    } else if(*value=='<') {
+        op = JEM_CONSTRAINT_LT;
+        value++;
+    } else if(*value=='=' || *value=='~') {
+        op = JEM_CONSTRAINT_EQ;
+        value++;
+    }
+    bool found = false;
+    while(*value) {
+        size_t len = strcspn(value," \t");
+        char *atom = strndup(value,len);
+        unsigned int parts = 0;
+        uint64_t version = atom ? jemVersionKey(atom,&parts) : 0;
+        free(atom);
+        if(parts && (!found || version<constraint->version)) {
+            constraint->version = version;
+            constraint->mask = ~(uint64_t)0 << (16*(JEM_VERSION_PARTS-parts));
+            found = true;
+        }
+        value += len;
+        while(isspace((unsigned char)*value))
+            value++;
+        if(op!=JEM_CONSTRAINT_GE)   // only a list of atoms has more than one
+            break;
+    }
+    if(found)
+        constraint->op = op;
+    return(found);
+}
+
+/**
+ * Check a version key against a constraint
+ *
+ * @param constraint pointer to a constraint struct
+ * @param version the version key
+ * @return true if the version satisfies the constraint, false otherwise
+ */
+bool jemConstraintMatches(const struct jem_constraint *constraint,uint64_t version) {
+    uint64_t masked = version & constraint->mask;
+    switch(constraint->op) {
+        case JEM_CONSTRAINT_EQ:
+            return(masked==constraint->version);
+        case JEM_CONSTRAINT_LT:
+            return(masked<constraint->version);
+        case JEM_CONSTRAINT_LE:
+            return(masked<=constraint->version);
+        case JEM_CONSTRAINT_GT:
+            return(masked>constraint->version);
+        case JEM_CONSTRAINT_GE:
+            return(version>=constraint->version);
+        default:
+            return(true);
+    }
+}
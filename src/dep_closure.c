@@ -0,0 +1,525 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "../include/dep_closure.h"
+
+#define JEM_DEP_CLOSURE_SLOTS_MIN 64
+
+/**
+ * FNV-1a hash of a name
+ */
+static uint32_t jemDepClosureHash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for(;*name;name++)
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return(hash);
+}
+
+/**
+ * Get the id of a name, adding a non package id if the name is not known
+ *
+ * @param closure a pointer to a closure struct, slots must have room
+ * @param name string containing the name
+ * @return the id, or -1 if out of memory
+ */
+static long jemDepClosureIntern(struct jem_dep_closure *closure,const char *name) {
+    long id = jemDepClosureId(closure,name);
+    if(id>=0)
+        return(id);
+    if((closure->count+1)*2>closure->mask+1) {
+        size_t size = (closure->mask+1)*2;
+        uint32_t *slots = calloc(size,sizeof(uint32_t));
+        if(!slots)
+            return(-1);
+        size_t i;
+        for(i=0;i<=closure->mask;i++) {
+            if(!closure->slots[i])
+                continue;
+            size_t s;
+            for(s=jemDepClosureHash(jemDepClosureName(closure,closure->slots[i]-1)) & (size-1);
+                slots[s];
+                s=(s+1) & (size-1));
+            slots[s] = closure->slots[i];
+        }
+        free(closure->slots);
+        closure->slots = slots;
+        closure->mask = size-1;
+    }
+    char **names = realloc(closure->names,sizeof(char *)*(closure->count-closure->pkg_count+1));
+    if(!names)
+        return(-1);
+    closure->names = names;
+    if(!(names[closure->count-closure->pkg_count] = strdup(name)))
+        return(-1);
+    size_t s;
+    for(s=jemDepClosureHash(name) & closure->mask;closure->slots[s];s=(s+1) & closure->mask);
+    closure->slots[s] = closure->count+1;
+    return(closure->count++);
+}
+
+/**
+ * Collect the direct dependencies of a package as pairs of ids. Like
+ * jemPkgGetDeps(), a jar@package dependency on a jar that is part of the
+ * package's own classpath is skipped.
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id of the package
+ * @param value string containing the dependencies, : separated
+ * @param classpath string containing the package's classpath, or null
+ * @param edges pointer to an array of id pairs, grown as needed
+ * @param edge_count pointer to the amount of pairs
+ * @param edge_size pointer to the allocated pairs
+ * @return true on success, false if out of memory
+ */
+static bool jemDepClosureAddDeps(struct jem_dep_closure *closure,
+                                 size_t id,
+                                 const char *value,
+                                 const char *classpath,
+                                 uint32_t **edges,
+                                 size_t *edge_count,
+                                 size_t *edge_size) {
+    char *deps_str = strdup(value);
+    if(!deps_str)
+        return(false);
+    char *cursor = deps_str;
+    char *dep_name;
+    while((dep_name = strsep(&cursor,":"))) {
+        char *pkg_name = strchr(dep_name,'@');    // jar@package depends on the package
+        if(pkg_name) {
+            *pkg_name++ = '\0';
+            if(classpath && strstr(classpath,dep_name))
+                continue;
+        } else
+            pkg_name = dep_name;
+        if(!*pkg_name)
+            continue;
+        long dep = jemDepClosureIntern(closure,pkg_name);
+        if(dep<0)
+            break;
+        if(*edge_count>=*edge_size) {
+            size_t size = *edge_size ? *edge_size*2 : JEM_DEP_CLOSURE_SLOTS_MIN;
+            uint32_t *tmp = realloc(*edges,sizeof(uint32_t)*2*size);
+            if(!tmp)
+                break;
+            *edges = tmp;
+            *edge_size = size;
+        }
+        (*edges)[*edge_count*2] = id;
+        (*edges)[*edge_count*2+1] = dep;
+        (*edge_count)++;
+    }
+    free(deps_str);
+    return(!dep_name);
+}
+
+/**
+ * OR the closure of each direct dependency into the closure of an id
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id
+ * @return true if the closure of the id changed, false otherwise
+ */
+static bool jemDepClosureMerge(struct jem_dep_closure *closure,size_t id) {
+    const uint64_t *direct = &closure->direct[id*closure->words];
+    uint64_t *dst = &closure->closure[id*closure->words];
+    bool changed = false;
+    size_t w;
+    for(w=0;w<closure->words;w++) {
+        uint64_t bits = direct[w];
+        while(bits) {
+            size_t dep = w*64+__builtin_ctzll(bits);
+            bits &= bits-1;
+            const uint64_t *src = &closure->closure[dep*closure->words];
+            uint64_t diff = 0;
+            size_t i;
+            for(i=0;i<closure->words;i++) {
+                diff |= src[i] & ~dst[i];
+                dst[i] |= src[i];
+            }
+            changed |= diff!=0;
+        }
+    }
+    return(changed);
+}
+
+/**
+ * Compute the transitive closure of all ids. Ids are merged in depth first
+ * post order, a single pass unless dependencies are circular.
+ *
+ * @param closure a pointer to a closure struct
+ * @return true on success, false if out of memory
+ */
+static bool jemDepClosureCompute(struct jem_dep_closure *closure) {
+    size_t *order = malloc(sizeof(size_t)*closure->count);
+    size_t *stack = malloc(sizeof(size_t)*closure->count*2);   // id and next bit
+    uint8_t *state = calloc(closure->count,sizeof(uint8_t));    // 0 new, 1 open, 2 done
+    if(!order || !stack || !state) {
+        free(order);
+        free(stack);
+        free(state);
+        return(false);
+    }
+    size_t n = 0;
+    size_t root;
+    for(root=0;root<closure->count;root++) {
+        if(state[root])
+            continue;
+        size_t depth = 0;
+        stack[0] = root;
+        stack[1] = 0;
+        state[root] = 1;
+        depth = 1;
+        while(depth) {
+            size_t id = stack[(depth-1)*2];
+            size_t bit = stack[(depth-1)*2+1];
+            const uint64_t *direct = &closure->direct[id*closure->words];
+            for(;bit<closure->count;bit++)
+                if((direct[bit/64]>>(bit%64)) & 1 && !state[bit])
+                    break;
+            if(bit<closure->count) {
+                stack[(depth-1)*2+1] = bit+1;
+                stack[depth*2] = bit;
+                stack[depth*2+1] = 0;
+                state[bit] = 1;
+                depth++;
+            } else {
+                state[id] = 2;
+                order[n++] = id;
+                depth--;
+            }
+        }
+    }
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(n=0;n<closure->count;n++)
+            changed |= jemDepClosureMerge(closure,order[n]);
+    }
+    free(order);
+    free(stack);
+    free(state);
+    return(true);
+}
+
+/**
+ * Transpose a bitset matrix, bit j of row i becomes bit i of row j
+ *
+ * @param closure a pointer to a closure struct
+ * @param src the matrix to transpose
+ * @param dst the zeroed matrix to set bits in
+ */
+static void jemDepClosureTranspose(struct jem_dep_closure *closure,const uint64_t *src,uint64_t *dst) {
+    size_t i;
+    for(i=0;i<closure->count;i++) {
+        const uint64_t *row = &src[i*closure->words];
+        size_t w;
+        for(w=0;w<closure->words;w++) {
+            uint64_t bits = row[w];
+            while(bits) {
+                size_t j = w*64+__builtin_ctzll(bits);
+                bits &= bits-1;
+                dst[j*closure->words+i/64] |= (uint64_t)1<<(i%64);
+            }
+        }
+    }
+}
+
+/**
+ * Build the dependency closure of all packages. Virtual dependencies are not
+ * expanded to a provider, their provider depends on the active vm.
+ *
+ * @param pkgs an array of pkg structs, as returned by jemPkgLoadPackages()
+ * @param key the id of the variable, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @return a closure struct, or null on error. Which must be freed using
+ *         jemFreeDepClosure(), the pkgs must outlive it!
+ */
+struct jem_dep_closure *jemDepClosureNew(struct jem_pkg *pkgs,enum jem_key key) {
+    return(jemDepClosureNewKeys(pkgs,&key,1));
+}
+
+/**
+ * Build the dependency closure of all packages over several kinds of
+ * dependencies at once, along with the inverted index of dependents
+ *
+ * @param pkgs an array of pkg structs, as returned by jemPkgLoadPackages()
+ * @param keys an array of variable ids, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @param key_count amount of keys
+ * @return a closure struct, or null on error. Which must be freed using
+ *         jemFreeDepClosure(), the pkgs must outlive it!
+ */
+struct jem_dep_closure *jemDepClosureNewKeys(struct jem_pkg *pkgs,const enum jem_key *keys,size_t key_count) {
+    struct jem_dep_closure *closure = calloc(1,sizeof(struct jem_dep_closure));
+    if(!closure) {
+        jemPrintError("Unable to allocate memory to hold dependency closure"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    closure->pkgs = pkgs;
+    for(;pkgs && pkgs[closure->pkg_count].filename;closure->pkg_count++);
+    size_t size = JEM_DEP_CLOSURE_SLOTS_MIN;
+    while(size<closure->pkg_count*2+2)
+        size *= 2;
+    closure->slots = calloc(size,sizeof(uint32_t));
+    closure->mask = size-1;
+    uint32_t *edges = NULL;
+    size_t edge_count = 0;
+    size_t edge_size = 0;
+    bool ok = closure->slots!=NULL;
+    size_t i;
+    for(i=0;ok && i<closure->pkg_count;i++) {
+        if(jemDepClosureId(closure,pkgs[i].name)<0) {   // first of a name wins
+            size_t s;
+            for(s=jemDepClosureHash(pkgs[i].name) & closure->mask;closure->slots[s];s=(s+1) & closure->mask);
+            closure->slots[s] = i+1;
+        }
+        closure->count++;
+    }
+    for(i=0;ok && i<closure->pkg_count;i++) {
+        size_t k;
+        for(k=0;ok && k<key_count;k++) {
+            char *value = jemGetKey(pkgs[i].params,keys[k]);
+            if(value)
+                ok = jemDepClosureAddDeps(closure,
+                                          i,
+                                          value,
+                                          jemPkgGetClasspath(pkgs[i].params),
+                                          &edges,
+                                          &edge_count,
+                                          &edge_size);
+        }
+    }
+    size_t bits = 0;
+    if(ok) {
+        closure->words = (closure->count+63)/64;
+        bits = closure->count*closure->words;
+        closure->direct = calloc(bits,sizeof(uint64_t));
+        closure->closure = malloc(sizeof(uint64_t)*bits);
+        closure->rdirect = calloc(bits,sizeof(uint64_t));
+        closure->rclosure = calloc(bits,sizeof(uint64_t));
+        ok = (closure->direct && closure->closure && closure->rdirect && closure->rclosure) ||
+             !closure->count;
+    }
+    if(ok) {
+        for(i=0;i<edge_count;i++) {
+            size_t dep = edges[i*2+1];
+            closure->direct[edges[i*2]*closure->words+dep/64] |= (uint64_t)1<<(dep%64);
+        }
+        memcpy(closure->closure,closure->direct,sizeof(uint64_t)*bits);
+        ok = jemDepClosureCompute(closure);
+    }
+    if(ok) {
+        jemDepClosureTranspose(closure,closure->direct,closure->rdirect);
+        jemDepClosureTranspose(closure,closure->closure,closure->rclosure);
+    }
+    free(edges);
+    if(!ok) {
+        jemPrintError("Unable to allocate memory to hold dependency closure"); // needs to clean up and exit under error, not just print a message
+        jemFreeDepClosure(closure);
+        return(NULL);
+    }
+    return(closure);
+}
+
+/**
+ * Frees the allocated memory used by a closure struct
+ *
+ * @param closure a pointer to a closure struct
+ */
+void jemFreeDepClosure(struct jem_dep_closure *closure) {
+    if(!closure)
+        return;
+    size_t i;
+    for(i=closure->pkg_count;i<closure->count;i++)
+        free(closure->names[i-closure->pkg_count]);
+    free(closure->names);
+    free(closure->direct);
+    free(closure->closure);
+    free(closure->rdirect);
+    free(closure->rclosure);
+    free(closure->slots);
+    free(closure);
+}
+
+/**
+ * Get the id of a package or dependency name
+ *
+ * @param closure a pointer to a closure struct
+ * @param name string containing the name
+ * @return the id, or -1 if the name is neither a package nor a dependency
+ */
+long jemDepClosureId(const struct jem_dep_closure *closure,const char *name) {
+    size_t s;
+    for(s=jemDepClosureHash(name) & closure->mask;closure->slots[s];s=(s+1) & closure->mask)
+        if(strcmp(jemDepClosureName(closure,closure->slots[s]-1),name)==0)
+            return(closure->slots[s]-1);
+    return(-1);
+}
+
+/**
+ * Get the name of an id
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id
+ * @return a string containing the value. The string must NOT be freed!
+ */
+const char *jemDepClosureName(const struct jem_dep_closure *closure,size_t id) {
+    if(id<closure->pkg_count)
+        return(closure->pkgs[id].name);
+    return(closure->names[id-closure->pkg_count]);
+}
+
+/**
+ * Get the transitive dependencies of a package, the bitset has
+ * closure->words words, bit id%64 of word id/64 is set for each dependency
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id of the package
+ * @return the bitset. Which must NOT be freed!
+ */
+const uint64_t *jemDepClosureGet(const struct jem_dep_closure *closure,size_t id) {
+    return(&closure->closure[id*closure->words]);
+}
+
+/**
+ * Convert a bitset of ids to dep structs, in id order
+ *
+ * @param closure a pointer to a closure struct
+ * @param bits the bitset
+ * @return an array of dep structs, or null if none. Which must be freed, including struct members!
+ */
+static struct jem_dep *jemDepClosureToDeps(const struct jem_dep_closure *closure,const uint64_t *bits) {
+    size_t count = 0;
+    size_t w;
+    for(w=0;w<closure->words;w++)
+        count += __builtin_popcountll(bits[w]);
+    if(!count)
+        return(NULL);
+    struct jem_dep *deps = calloc(count+1,sizeof(struct jem_dep));
+    if(!deps) {
+        jemPrintError("Unable to allocate memory to hold all dependencies"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    size_t n = 0;
+    for(w=0;w<closure->words;w++) {
+        uint64_t word = bits[w];
+        while(word) {
+            size_t id = w*64+__builtin_ctzll(word);
+            word &= word-1;
+            deps[n].name = strdup(jemDepClosureName(closure,id));
+            if(id<closure->pkg_count)
+                deps[n].filename = strdup(closure->pkgs[id].filename);
+            n++;
+        }
+    }
+    return(deps);
+}
+
+/**
+ * Get the transitive dependencies of a package as dep structs, in id order
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id of the package
+ * @return an array of dep structs, or null if none. Only the name and, if the
+ *         dependency is an installed package, the filename are set. Which must
+ *         be freed, including struct members!
+ */
+struct jem_dep *jemDepClosureDeps(const struct jem_dep_closure *closure,size_t id) {
+    return(jemDepClosureToDeps(closure,jemDepClosureGet(closure,id)));
+}
+
+/**
+ * Get the transitive dependencies shared by all of several packages
+ *
+ * @param closure a pointer to a closure struct
+ * @param ids an array of package ids
+ * @param count amount of ids
+ * @return an array of dep structs, or null if none. Only the name and, if the
+ *         dependency is an installed package, the filename are set. Which must
+ *         be freed, including struct members!
+ */
+struct jem_dep *jemDepClosureShared(const struct jem_dep_closure *closure,const size_t *ids,size_t count) {
+    if(!count)
+        return(NULL);
+    uint64_t *bits = malloc(sizeof(uint64_t)*closure->words);
+    if(!bits) {
+        jemPrintError("Unable to allocate memory to hold all dependencies"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    memcpy(bits,jemDepClosureGet(closure,ids[0]),sizeof(uint64_t)*closure->words);
+    size_t i;
+    for(i=1;i<count;i++) {
+        const uint64_t *src = jemDepClosureGet(closure,ids[i]);
+        size_t w;
+        for(w=0;w<closure->words;w++)
+            bits[w] &= src[w];
+    }
+    struct jem_dep *deps = jemDepClosureToDeps(closure,bits);
+    free(bits);
+    return(deps);
+}
+
+/**
+ * Get the packages depending on an id, the bitset has closure->words words,
+ * bit id%64 of word id/64 is set for each dependent
+ *
+ * @param closure a pointer to a closure struct
+ * @param id the id of the package or dependency
+ * @param transitive include packages depending on it through other packages
+ * @return the bitset. Which must NOT be freed!
+ */
+const uint64_t *jemDepClosureGetDependents(const struct jem_dep_closure *closure,size_t id,bool transitive) {
+    return(&(transitive ? closure->rclosure : closure->rdirect)[id*closure->words]);
+}
+
+/**
+ * Get the packages depending on any of several ids, excluding the ids
+ *
+ * @param closure a pointer to a closure struct
+ * @param ids an array of package or dependency ids
+ * @param count amount of ids
+ * @param transitive include packages depending on them through other packages
+ * @return an array of dep structs, or null if none. Only the name and the
+ *         filename are set. Which must be freed, including struct members!
+ */
+struct jem_dep *jemDepClosureDependents(const struct jem_dep_closure *closure,
+                                        const size_t *ids,
+                                        size_t count,
+                                        bool transitive) {
+    uint64_t *bits = calloc(closure->words ? closure->words : 1,sizeof(uint64_t));
+    if(!bits) {
+        jemPrintError("Unable to allocate memory to hold all dependents"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    size_t i;
+    size_t w;
+    for(i=0;i<count;i++) {
+        const uint64_t *src = jemDepClosureGetDependents(closure,ids[i],transitive);
+        for(w=0;w<closure->words;w++)
+            bits[w] |= src[w];
+    }
+    for(i=0;i<count;i++)
+        bits[ids[i]/64] &= ~((uint64_t)1<<(ids[i]%64));
+    struct jem_dep *deps = jemDepClosureToDeps(closure,bits);
+    free(bits);
+    return(deps);
+}
@@ -0,0 +1,376 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "../include/dep_graph.h"
+
+#define JEM_DEP_GRAPH_NODES_MIN 16
+#define JEM_DEP_GRAPH_JARS_MIN 4
+
+/**
+ * Per node bookkeeping, parallel to the dep struct array
+ */
+struct jem_dep_node {
+    uint32_t hash;          /** hash of the package name */
+    size_t jar_count;       /** amount of jars */
+    size_t jar_size;        /** allocated jars, excluding the terminator */
+    bool merged;            /** all package jars have been added */
+};
+
+/**
+ * Hash set entry of a jar of a node
+ */
+struct jem_dep_jar {
+    uint32_t node;          /** node index */
+    uint32_t hash;          /** hash of the node index and jar name */
+};
+
+/**
+ * Dependency graph, nodes double as the breadth first queue
+ */
+struct jem_dep_graph {
+    struct jem_dep *deps;           /** nodes, terminated by a null name */
+    struct jem_dep_node *nodes;     /** node bookkeeping */
+    size_t count;                   /** amount of nodes */
+    size_t size;                    /** allocated nodes, excluding the terminator */
+    uint32_t *slots;                /** name hash slots, node index + 1 or 0 */
+    size_t mask;                    /** name hash slots - 1 */
+    struct jem_dep_jar *jars;       /** jar hash set entries */
+    const char **jar_names;         /** jar name of each entry */
+    size_t jar_count;               /** amount of jar entries */
+    size_t jar_size;                /** allocated jar entries */
+    uint32_t *jar_slots;            /** jar hash slots, entry index + 1 or 0 */
+    size_t jar_mask;                /** jar hash slots - 1 */
+};
+
+/**
+ * FNV-1a hash of a string
+ *
+ * @param hash the starting hash, 2166136261 or a previous hash
+ * @param str the string to hash
+ * @return the hash
+ */
+static uint32_t jemDepHash(uint32_t hash,const char *str) {
+    for(;*str;str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 16777619u;
+    }
+    return(hash);
+}
+
+/**
+ * Grow a hash slot table, rehashing all entries
+ *
+ * @param slots pointer to the slots, replaced on success
+ * @param mask pointer to the slots mask, replaced on success
+ * @param count amount of entries
+ * @param hash function to get the hash of an entry
+ * @return true on success, false otherwise
+ */
+static bool jemDepGraphRehash(uint32_t **slots,
+                              size_t *mask,
+                              size_t count,
+                              uint32_t (*hash)(struct jem_dep_graph *graph,size_t i),
+                              struct jem_dep_graph *graph) {
+    size_t size = *slots ? (*mask+1)*2 : JEM_DEP_GRAPH_NODES_MIN;
+    uint32_t *nslots = calloc(size,sizeof(uint32_t));
+    if(!nslots) {
+        jemPrintError("Unable to allocate memory to hold dependency graph"); // needs to clean up and exit under error, not just print a message
+        return(false);
+    }
+    size_t i;
+    for(i=0;i<count;i++) {
+        size_t s;
+        for(s=hash(graph,i) & (size-1);nslots[s];s=(s+1) & (size-1));
+        nslots[s] = i+1;
+    }
+    free(*slots);
+    *slots = nslots;
+    *mask = size-1;
+    return(true);
+}
+
+/**
+ * Get the hash of a node, used by jemDepGraphRehash()
+ */
+static uint32_t jemDepGraphNodeHash(struct jem_dep_graph *graph,size_t i) {
+    return(graph->nodes[i].hash);
+}
+
+/**
+ * Get the hash of a jar entry, used by jemDepGraphRehash()
+ */
+static uint32_t jemDepGraphJarHash(struct jem_dep_graph *graph,size_t i) {
+    return(graph->jars[i].hash);
+}
+
+/**
+ * Get or add the node of a package
+ *
+ * @param graph pointer to a dependency graph
+ * @param name string containing the package name
+ * @param added set true if the node was added, false if it existed
+ * @return the node index, or -1 on error
+ */
+static long jemDepGraphNode(struct jem_dep_graph *graph,const char *name,bool *added) {
+    uint32_t hash = jemDepHash(2166136261u,name);
+    size_t s;
+    *added = false;
+    if(graph->slots) {
+        for(s=hash & graph->mask;graph->slots[s];s=(s+1) & graph->mask) {
+            size_t i = graph->slots[s]-1;
+            if(graph->nodes[i].hash==hash && strcmp(graph->deps[i].name,name)==0)
+                return(i);
+        }
+    }
+    if(graph->count>=graph->size) {
+        size_t size = graph->size ? graph->size*2 : JEM_DEP_GRAPH_NODES_MIN;
+        struct jem_dep *deps = realloc(graph->deps,sizeof(struct jem_dep)*(size+1));
+        if(deps)
+            graph->deps = deps;
+        struct jem_dep_node *nodes = realloc(graph->nodes,sizeof(struct jem_dep_node)*size);
+        if(nodes)
+            graph->nodes = nodes;
+        if(!deps || !nodes) {
+            jemPrintError("Unable to allocate memory to hold all dependencies"); // needs to clean up and exit under error, not just print a message
+            return(-1);
+        }
+        graph->size = size;
+    }
+    if((graph->count+1)*2>(graph->slots ? graph->mask+1 : 0) &&
+       !jemDepGraphRehash(&graph->slots,&graph->mask,graph->count,jemDepGraphNodeHash,graph))
+        return(-1);
+    size_t i = graph->count;
+    struct jem_dep *dep = &graph->deps[i];
+    memset(dep,0,sizeof(struct jem_dep)*2);    // node and terminator
+    memset(&graph->nodes[i],0,sizeof(struct jem_dep_node));
+    dep->name = strdup(name);
+    if(!dep->name) {
+        jemPrintError("Unable to allocate memory to hold dependency name"); // needs to clean up and exit under error, not just print a message
+        return(-1);
+    }
+    graph->nodes[i].hash = hash;
+    for(s=hash & graph->mask;graph->slots[s];s=(s+1) & graph->mask);
+    graph->slots[s] = i+1;
+    graph->count++;
+    *added = true;
+    return(i);
+}
+
+/**
+ * Add a jar to a node, unless the node already has it
+ *
+ * @param graph pointer to a dependency graph
+ * @param node the node index
+ * @param jar string containing the jar name
+ */
+static void jemDepGraphAddJar(struct jem_dep_graph *graph,size_t node,const char *jar) {
+    uint32_t hash = jemDepHash(2166136261u ^ (uint32_t)node,jar);
+    size_t s;
+    if(graph->jar_slots) {
+        for(s=hash & graph->jar_mask;graph->jar_slots[s];s=(s+1) & graph->jar_mask) {
+            size_t e = graph->jar_slots[s]-1;
+            if(graph->jars[e].node==node &&
+               graph->jars[e].hash==hash &&
+               strcmp(graph->jar_names[e],jar)==0)
+                return;
+        }
+    }
+    struct jem_dep *dep = &graph->deps[node];
+    struct jem_dep_node *n = &graph->nodes[node];
+    if(n->jar_count>=n->jar_size) {
+        size_t size = n->jar_size ? n->jar_size*2 : JEM_DEP_GRAPH_JARS_MIN;
+        char **jars = realloc(dep->jars,sizeof(char *)*(size+1));
+        if(!jars) {
+            jemPrintError("Unable to allocate memory to hold all dependency jars"); // needs to clean up and exit under error, not just print a message
+            return;
+        }
+        dep->jars = jars;
+        n->jar_size = size;
+    }
+    if(graph->jar_count>=graph->jar_size) {
+        size_t size = graph->jar_size ? graph->jar_size*2 : JEM_DEP_GRAPH_NODES_MIN;
+        struct jem_dep_jar *jars = realloc(graph->jars,sizeof(struct jem_dep_jar)*size);
+        if(jars)
+            graph->jars = jars;
+        const char **names = realloc(graph->jar_names,sizeof(char *)*size);
+        if(names)
+            graph->jar_names = names;
+        if(!jars || !names) {
+            jemPrintError("Unable to allocate memory to hold all dependency jars"); // needs to clean up and exit under error, not just print a message
+            return;
+        }
+        graph->jar_size = size;
+    }
+    if((graph->jar_count+1)*2>(graph->jar_slots ? graph->jar_mask+1 : 0) &&
+       !jemDepGraphRehash(&graph->jar_slots,&graph->jar_mask,graph->jar_count,jemDepGraphJarHash,graph))
+        return;
+    char *name = strdup(jar);
+    if(!name) {
+        jemPrintError("Unable to allocate memory to hold dependency jar"); // needs to clean up and exit under error, not just print a message
+        return;
+    }
+    dep->jars[n->jar_count++] = name;
+    dep->jars[n->jar_count] = NULL;
+    size_t e = graph->jar_count++;
+    graph->jars[e].node = node;
+    graph->jars[e].hash = hash;
+    graph->jar_names[e] = name;
+    for(s=hash & graph->jar_mask;graph->jar_slots[s];s=(s+1) & graph->jar_mask);
+    graph->jar_slots[s] = e+1;
+}
+
+/**
+ * Add the direct dependencies of a package to the graph. A dependency of the
+ * form jar@package adds only that jar, unless the whole package is already a
+ * dependency, or the jar is part of the package's own classpath.
+ *
+ * @param graph pointer to a dependency graph
+ * @param params an array of param structs of the package
+ * @param key the id of the variable, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ */
+static void jemDepGraphAddDeps(struct jem_dep_graph *graph,
+                               struct jem_param *params,
+                               enum jem_key key) {
+    char *value = jemGetKey(params,key);
+    if(!value)
+        return;
+    char *deps_str = strdup(value);
+    if(!deps_str) {
+        jemPrintError("Unable to allocate memory to hold all dependencies"); // needs to clean up and exit under error, not just print a message
+        return;
+    }
+    char *classpath = jemPkgGetClasspath(params);
+    char *cursor = deps_str;
+    char *dep_name;
+    while((dep_name = strsep(&cursor,":"))) {
+        char *jar = NULL;
+        char *pkg_name = strchr(dep_name,'@');
+        if(pkg_name) {
+            *pkg_name++ = '\0';
+            jar = dep_name;
+            if(classpath && strstr(classpath,jar))
+                continue;
+        } else
+            pkg_name = dep_name;
+        if(!*pkg_name)
+            continue;
+        bool added;
+        long node = jemDepGraphNode(graph,pkg_name,&added);
+        if(node<0)
+            break;
+        if(jar) {
+            if(added || graph->deps[node].jars)   // whole package takes precedence
+                jemDepGraphAddJar(graph,node,jar);
+        } else if(graph->deps[node].jars && !graph->nodes[node].merged) {
+            graph->nodes[node].merged = true;
+            char **jars = jemPkgGetJarNames(pkg_name);
+            if(jars) {
+                int j;
+                for(j=0;jars[j];j++)
+                    jemDepGraphAddJar(graph,node,jars[j]);
+            }
+        }
+    }
+    free(deps_str);
+}
+
+/**
+ * Start reading ahead the package.env files of all nodes not yet loaded
+ *
+ * @param graph pointer to the graph
+ * @param first the index of the first node not yet loaded
+ * @return a prefetch, or null if not in use. Which must be freed using jemPkgFreePrefetch()!
+ */
+static struct jem_pkg_prefetch *jemDepGraphPrefetch(struct jem_dep_graph *graph,size_t first) {
+    size_t count = graph->count-first;
+    char **names = malloc(sizeof(char *)*count);
+    if(!names)
+        return(NULL);
+    size_t i;
+    for(i=0;i<count;i++)
+        names[i] = graph->deps[first+i].name;
+    struct jem_pkg_prefetch *prefetch = jemPkgPrefetch(names,count);
+    free(names);
+    return(prefetch);
+}
+
+/**
+ * Resolve the transitive dependencies of a package. Each package becomes a
+ * single node, loaded once, nodes are in breadth first discovery order.
+ *
+ * @param params an array of param structs of the package
+ * @param key the id of the variable, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @return an array of dep structs, or null if none. Which must be freed, including struct members!
+ */
+struct jem_dep *jemDepGraphResolve(struct jem_param *params,enum jem_key key) {
+    return(jemDepGraphResolveAll(&params,1,key));
+}
+
+/**
+ * Resolve the combined transitive dependencies of several packages. Shared
+ * dependencies become a single node, nodes are in breadth first discovery
+ * order, starting with the direct dependencies of each package in turn.
+ *
+ * @param params an array of param struct arrays, one for each package
+ * @param count amount of packages
+ * @param key the id of the variable, JEM_KEY_DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
+ * @return an array of dep structs, or null if none. Which must be freed, including struct members!
+ */
+struct jem_dep *jemDepGraphResolveAll(struct jem_param **params,size_t count,enum jem_key key) {
+    struct jem_dep_graph graph;
+    memset(&graph,0,sizeof(graph));
+    size_t i;
+    for(i=0;i<count;i++)
+        jemDepGraphAddDeps(&graph,params[i],key);
+    struct jem_pkg_prefetch *prefetch = NULL;
+    bool read_ahead = jemIoAvailable();
+    size_t first = 0;
+    for(i=0;i<graph.count;i++) {
+        if(read_ahead && (!prefetch || i-first>=prefetch->count)) {
+            jemPkgFreePrefetch(prefetch);   // next level, read while parsing
+            first = i;
+            read_ahead = (prefetch = jemDepGraphPrefetch(&graph,i))!=NULL;
+        }
+        graph.deps[i].parsed_sub_deps = true;
+        struct jem_pkg *pkg = jemPkgLoadPrefetched(prefetch,i-first,graph.deps[i].name);
+        if(pkg) {
+            graph.deps[i].filename = pkg->filename;
+            graph.deps[i].params = pkg->params;
+            graph.deps[i].stamp = pkg->stamp;
+            pkg->filename = NULL;
+            pkg->params = NULL;
+            jemDepGraphAddDeps(&graph,graph.deps[i].params,key);
+            jemFreePkg(pkg);
+            free(pkg);
+        }
+    }
+    jemPkgFreePrefetch(prefetch);
+    free(graph.nodes);
+    free(graph.slots);
+    free(graph.jars);
+    free(graph.jar_names);
+    free(graph.jar_slots);
+    return(graph.deps);
+}
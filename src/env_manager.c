@@ -21,6 +21,7 @@
  *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <ctype.h>
 #include <errno.h>
 #ifdef HAVE_MUSL
 #include <err.h>
@@ -32,6 +33,8 @@
 #include <unistd.h>
 #include <sys/dir.h>
 #include <sys/stat.h>
+#include "../include/dep_closure.h"
+#include "../include/dep_graph.h"
 #include "../include/env_manager.h"
 
 /**
@@ -39,6 +42,12 @@
  */
 void jemCleanup(void) {
     jemFreeEnv(&jem_env);
+    jemInitEnv(&jem_env);   // vms may be loaded again, e.g. by jemSelectVM
+    jemFreeVirtuals();
+    jemFreeJarNames();
+    jemFreePkgSlots();
+    jemClasspathCacheClose();
+    jemSnapshotClose();
 }
 
 /**
@@ -50,29 +59,56 @@ void jemFreeEnv(struct jem_env *env) {
     if(!env)
         return;
     jemFreePkgs(env->pkgs);
+    jemFreeVmIndex(env->vm_index);
     jemFreeVMs(env->vms);
+    jemFreeVMs(env->lazy_vm);
+}
+
+/**
+ * Load and index all vms of an env, an active vm loaded alone is replaced by
+ * its entry in the vms
+ *
+ * @param env pointer to an env struct
+ */
+static void jemLoadEnvVMs(struct jem_env *env) {
+    if(env->vms) {
+        if(!env->vm_index)  // vms loaded by the caller
+            env->vm_index = jemVmIndexNew(env->vms,env->vm_count);
+        return;
+    }
+    env->vms = jemVmLoadVMs(&(env->vm_count));
+    if(env->vms)
+        env->vm_index = jemVmIndexNew(env->vms,env->vm_count);
+    if(env->vms && env->lazy_vm && env->active_vm==env->lazy_vm) {
+        int i;
+        for(i=0;env->vms[i].filename;i++) {
+            if(strcmp(env->vms[i].filename,env->lazy_vm->filename)==0) {
+                env->active_vm = &(env->vms[i]);
+                break;
+            }
+        }
+    }
 }
 
 /**
  * Initialize env vms (virtual machines)
  */
 void initEnvVMs(void) {
-    if(!jem_env.vms)
-        jem_env.vms = jemVmLoadVMs(&(jem_env.vm_count));
+    jemLoadEnvVMs(&jem_env);
 }
 
 /**
  * Execute something which is in JAVA_HOME
  */
 void jemExeJavaBin(char *exe_name) {
-    initEnvVMs();
     struct jem_vm *avm = jemGetActiveVM(&jem_env);
     if(avm) {
-        char *exec;
-        asprintf(&exec,"%s/bin/%s",jemGetValue(avm->params,"JAVA_HOME"),exe_name);
-        if(exec) {
+        char *exec = jemVmGetTool(avm,exe_name);
+        if(!exec)
+            jemPrintError("Invalid java executable, bad path or file name");
+        else {
             char *argv[] = { exec, "-version", NULL };
-            int e = execve(exec,argv,NULL);
+            int e = execve(exec,argv,environ);
             if(e==-1)
                 jemPrintError("Unable to execute command");
             free(exec);
@@ -104,31 +140,42 @@ struct jem_vm *jemGetActiveVM(struct jem_env *env) {
  */
 struct jem_vm **jemFindVM(char *name) {
     initEnvVMs();
-    struct jem_vm **vms = NULL;
+    struct jem_vm **vms = jemVmIndexPrefixed(jem_env.vm_index,name ? name : "");
+    if(!name || !*name)
+        return(vms);
+    size_t len = strlen(name);
     int i;
     int vm_count = 0;
-    for(i=0;jem_env.vms[i].filename;i++) {
-        char *vname = NULL;
-        asprintf(&vname,"%s-%s",name,jemVmGetVersion(jem_env.vms[i].params));
-        if(!name ||
-           strlen(name)==0 ||
-           strcmp(jemVmGetName(&(jem_env.vms[i])),name)==0 ||
-           strcmp(jemVmGetName(&(jem_env.vms[i])),vname)==0) {
-            struct jem_vm **tmp = realloc(vms,sizeof(struct jem_vm *)*(vm_count+2));
-            if(tmp) {
-                vms = tmp;
-                vms[vm_count] = &(jem_env.vms[i]);
-                vms[vm_count+1] = NULL;
-                vm_count++;
-            } else
-                jemPrintError("Unable to reallocate memory for VM pointers");
-        }
-        if(vname)
-            free(vname);
+    for(i=0;vms && vms[i];i++) {
+        const char *vm_name = jemVmGetName(vms[i]);
+        const char *version = jemVmGetVersion(vms[i]->params);
+        if(strcmp(vm_name,name)==0 ||
+           (version &&
+            strncmp(vm_name,name,len)==0 &&
+            vm_name[len]=='-' &&
+            strcmp(vm_name+len+1,version)==0))
+            vms[vm_count++] = vms[i];
+    }
+    if(!vm_count) {
+        free(vms);
+        return(NULL);
     }
+    vms[vm_count] = NULL;
     return(vms);
 }
 
+/**
+ * Get a VM by number, config file name, JAVA_HOME, or VM name, an exact name
+ * or the unique prefix of one VM's name
+ *
+ * @param vm_name string containing the vm number, path or name
+ * @return a pointer to a vm struct, or null if not found. Must NOT be freed!
+ */
+struct jem_vm *jemGetVM(const char *vm_name) {
+    initEnvVMs();
+    return(jemVmIndexGet(jem_env.vm_index,vm_name));
+}
+
 /**
  * Initialize env struct
  *
@@ -138,6 +185,27 @@ void jemInitEnv(struct jem_env *env) {
     env->pkgs = NULL;
     env->vms = NULL;
     env->active_vm = NULL;
+    env->lazy_vm = NULL;
+    env->vm_index = NULL;
+}
+
+/**
+ * Get a vm of an env by name. Until the env's vms are loaded, the name of a VM
+ * config file is loaded alone, any other name loads all vms to match it.
+ *
+ * @param env pointer to an env struct
+ * @param vm_name string containing the vm name, number, or JAVA_HOME
+ * @return a pointer to a vm struct, or null if not found. Must NOT be freed!
+ */
+static struct jem_vm *jemGetEnvVM(struct jem_env *env,const char *vm_name) {
+    if(!env->vms && !isdigit((unsigned char)vm_name[0])) {  // numbers index all vms
+        if(!env->lazy_vm)
+            env->lazy_vm = jemVmLoadVM(vm_name);
+        if(env->lazy_vm && strcmp(jemVmGetName(env->lazy_vm),vm_name)==0)
+            return(env->lazy_vm);
+    }
+    jemLoadEnvVMs(env);
+    return(jemVmIndexGet(env->vm_index,vm_name));
 }
 
 /**
@@ -154,7 +222,7 @@ struct jem_vm *jemLoadActiveVM(struct jem_env *env) {
     if((tainted = getenv("JEM_VM"))) {
         vm_name = strndup(tainted,1024);
         if(vm_name) {
-            vm = jemVmGetVM(env->vms,&(env->vm_count),vm_name);
+            vm = jemGetEnvVM(env,vm_name);
             free(vm_name);
         }
     } else {
@@ -172,7 +240,7 @@ struct jem_vm *jemLoadActiveVM(struct jem_env *env) {
                 free(abs_file);
                 continue;
             }
-            vm = jemVmGetVM(env->vms,&(env->vm_count),basename(abs_file));
+            vm = jemGetEnvVM(env,basename(abs_file));
             free(abs_file);
             if(vm)
                 break;
@@ -200,31 +268,39 @@ void jemListAvailableVMs(void) {
     int i;
     for(i=0;jem_env.vms[i].filename;i++) {
         char *msg;
+        char *version = jemVmGetVersion(jem_env.vms[i].params);
+        char *java_version = jemGetValue(jemVmGetRelease(&(jem_env.vms[i])),"JAVA_VERSION");
+        char *desc = NULL;
+        if(java_version)
+            asprintf(&desc,"%s (%s)",version,java_version);
+        if(desc)
+            version = desc;
         if(avm && strcmp(avm->filename,jem_env.vms[i].filename)==0) {
             if(jemVmIsBuildOnly(jem_env.vms[i].params)) {
                 asprintf(&msg,
                          "%%G*)\t%s [%s] %%r(Build Only)%%$",
-                         jemVmGetVersion(jem_env.vms[i].params),
+                         version,
                          jemVmGetName(&(jem_env.vms[i])));
                 has_build_only = true;
             } else
                 asprintf(&msg,"%%G*)\t%s [%s]%%$",
-                         jemVmGetVersion(jem_env.vms[i].params),
+                         version,
                          jemVmGetName(&(jem_env.vms[i])));
         } else {
             if(jemVmIsBuildOnly(jem_env.vms[i].params)) {
                 asprintf(&msg,
                          "%d)\t%s [%s] %%r(Build Only)%%$",
                          i+1,
-                         jemVmGetVersion(jem_env.vms[i].params),
+                         version,
                          jemVmGetName(&(jem_env.vms[i])));
                 has_build_only = true;
             } else
                 asprintf(&msg,"%d)\t%s [%s]",
                          i+1,
-                         jemVmGetVersion(jem_env.vms[i].params),
+                         version,
                          jemVmGetName(&(jem_env.vms[i])));
         }
+        free(desc);
         if(msg) {
             jemPrint(stdout,msg);
             free(msg);
@@ -289,7 +365,6 @@ void jemListPackages(void) {
  * Print the active VM
  */
 void jemPrintActiveVM(void) {
-    initEnvVMs();
     struct jem_vm *avm = jemGetActiveVM(&jem_env);
     if(avm)
         jemPrint(stdout,jemVmGetName(avm));
@@ -299,8 +374,7 @@ void jemPrintActiveVM(void) {
  * Print the active VM parameters
  */
 void jemPrintVMParams(const char *vm_name) {
-    initEnvVMs();
-    struct jem_vm *vm = jemVmGetVM(jem_env.vms,&(jem_env.vm_count),vm_name);
+    struct jem_vm *vm = jemGetVM(vm_name);
     if(vm) {
         int i;
         for(i=0;vm->params[i].name;i++)
@@ -314,11 +388,12 @@ void jemPrintVMParams(const char *vm_name) {
  * @param exec string containing the executable to print
  */
 void jemPrintExe(const char *exe) {
-    initEnvVMs();
     struct jem_vm *avm = jemGetActiveVM(&jem_env);
     if(avm) {
-        char *e = jemVmGetExec(avm->params,exe);
-        if(e) {
+        char *e = jemVmGetTool(avm,exe);
+        if(!e)
+            jemPrintError("Invalid java executable, bad path or file name");
+        else {
             jemPrint(stdout,e);
             free(e);
         }
@@ -326,16 +401,28 @@ void jemPrintExe(const char *exe) {
 }
 
 /**
- * Print the active VM java version
+ * Print the active VM java version, from its JAVA_HOME/release file if it has
+ * one, otherwise by executing java -version
  */
 void jemPrintJavaVersion(void) {
-    initEnvVMs();
     struct jem_vm *avm = jemGetActiveVM(&jem_env);
     if(avm) {
-        char *exec = jemVmGetExec(avm->params,"java");
-        if(exec) {
+        struct jem_param *release = jemVmGetRelease(avm);
+        char *version = jemGetValue(release,"JAVA_VERSION");
+        if(version) {
+            char *date = jemGetValue(release,"JAVA_VERSION_DATE");
+            char *implementor = jemGetValue(release,"IMPLEMENTOR");
+            fprintf(stdout,"java version \"%s\"%s%s\n",version,date ? " " : "",date ? date : "");
+            if(implementor)
+                fprintf(stdout,"%s\n",implementor);
+            return;
+        }
+        char *exec = jemVmGetTool(avm,"java");   // no release file, ask the VM
+        if(!exec)
+            jemPrintError("Invalid java executable, bad path or file name");
+        else {
             char *argv[] = { exec, "-version", NULL };
-            int e = execve(exec,argv,NULL);
+            int e = execve(exec,argv,environ);
             if(e==-1)
                 jemPrintError("Unable to print java version");
             free(exec);
@@ -344,68 +431,181 @@ void jemPrintJavaVersion(void) {
 }
 
 /**
- * Print one or more package classpath values from the package.env file
+ * Add a source to a null terminated array of classpath cache sources
+ *
+ * @param sources pointer to an array of strings, which must be freed along with its strings!
+ * @param stamps pointer to an array of the stamps of the sources, which must be freed!
+ * @param count pointer to the amount of sources
+ * @param stamp pointer to the stamp of the source as read, or null to stamp it now
+ * @param fmt printf format of the source file or directory name
+ * @param name string substituted into the format
+ */
+static void jemAddCacheSource(char ***sources,
+                              struct jem_snapshot_stamp **stamps,
+                              int *count,
+                              const struct jem_snapshot_stamp *stamp,
+                              const char *fmt,
+                              const char *name) {
+    char **tmp = realloc(*sources,sizeof(char *)*(*count+2));
+    if(tmp)
+        *sources = tmp;
+    struct jem_snapshot_stamp *stmp = tmp ? realloc(*stamps,sizeof(struct jem_snapshot_stamp)*(*count+1)) : NULL;
+    if(!stmp) {
+        jemPrintError("Unable to allocate memory to hold classpath cache sources"); // needs to clean up and exit under error, not just print a message
+        return;
+    }
+    *stamps = stmp;
+    tmp[*count] = NULL;
+    asprintf(&tmp[*count],fmt,name);
+    if(tmp[*count]) {
+        if(stamp)
+            stmp[*count] = *stamp;
+        else
+            jemSnapshotStampFile(&stmp[*count],tmp[*count]);
+        (*count)++;
+    }
+    tmp[*count] = NULL;
+}
+
+/**
+ * Append the classpaths of packages preceded by the combined classpath of
+ * their dependencies, shared dependencies are resolved once and each entry is
+ * appended once. The result is cached persistently, unless a dependency was
+ * not found or a virtual is involved, its provider depends on the active vm.
+ *
+ * @param classpath pointer to an empty string builder to append to
+ * @param pkgs an array of pointers to pkg structs
+ * @param count amount of packages
+ * @param name string containing the comma separated package names, the cache key
+ * @param found set false if a dependency was not found
+ */
+static void jemAppendPackagesDepsClasspath(struct jem_str *classpath,
+                                           struct jem_pkg **pkgs,
+                                           int count,
+                                           const char *name,
+                                           bool *found) {
+    char **sources = NULL;
+    struct jem_snapshot_stamp *stamps = NULL;
+    int sources_count = 0;
+    bool cache = true;
+    struct jem_param **params = calloc(count,sizeof(struct jem_param *));
+    if(!params) {
+        jemPrintError("Unable to allocate memory to hold packages"); // needs to clean up and exit under error, not just print a message
+        *found = false;
+        return;
+    }
+    int i;
+    for(i=0;i<count;i++) {
+        if(jemPkgGetVirtual(pkgs[i]->name))
+            cache = false;
+        jemAddCacheSource(&sources,&stamps,&sources_count,&pkgs[i]->stamp,"%s",pkgs[i]->filename);
+        params[i] = pkgs[i]->params;
+    }
+    struct jem_dep *deps = jemDepGraphResolveAll(params,count,JEM_KEY_DEPEND);
+    free(params);
+    for(i=0;deps && deps[i].name;i++) {
+        if(jemPkgGetVirtual(deps[i].name))
+            cache = false;
+        if(deps[i].filename)    // its DEPEND was followed, jar deps included
+            jemAddCacheSource(&sources,&stamps,&sources_count,&deps[i].stamp,"%s",deps[i].filename);
+        if(deps[i].jars) {
+            jemAddCacheSource(&sources,&stamps,&sources_count,NULL,JEM_PKG_PATH "%s/lib",deps[i].name);
+            int j;
+            for(j=0;deps[i].jars[j];j++) {
+                jemStrAppendSep(classpath,":",JEM_PKG_PATH);
+                jemStrAppend(classpath,deps[i].name);
+                jemStrAppend(classpath,"/lib/");
+                jemStrAppend(classpath,deps[i].jars[j]);
+            }
+        } else if(deps[i].params) {
+            // none for a virtual the vm provides
+            jemStrAppendSep(classpath,":",jemPkgGetClasspath(deps[i].params));
+        } else {
+            char *msg;
+            asprintf(&msg,"Package %s a dependency of package %s was not found!",deps[i].name,name);
+            jemPrintError(msg);
+            free(msg);
+            *found = false;
+            break;
+        }
+    }
+    for(i=0;deps && deps[i].name;i++)
+        jemFreeDep(&deps[i]);
+    free(deps);
+    for(i=0;i<count;i++)
+        jemStrAppendSep(classpath,":",jemPkgGetClasspath(pkgs[i]->params));
+    jemStrDedup(classpath,':');
+    if(cache && *found && classpath->str && sources)
+        jemClasspathCachePut(name,classpath->str,sources,stamps);
+    for(i=0;i<sources_count;i++)
+        free(sources[i]);
+    free(sources);
+    free(stamps);
+}
+
+/**
+ * Resolve one or more package names using the package slot index, a name not
+ * installed is kept, with base:slot written as base-slot
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified
+ * @return a string containing the resolved package name(s), or null if out of
+ *         memory. Which must be freed!
+ */
+static char *jemResolvePackageNames(const char *name) {
+    char *names_str = strdup(name);
+    if(!names_str) {
+        jemPrintError("Unable to allocate memory to hold package names"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    struct jem_str resolved = { NULL, 0, 0 };
+    char *cursor = names_str;
+    char *pkg_name;
+    while((pkg_name = strsep(&cursor,","))) {
+        const char *pkg = jemPkgResolveName(pkg_name);
+        if(!pkg) {
+            char *c;
+            for(c=pkg_name;*c;c++)
+                if(*c == ':')
+                    *c = '-';
+            pkg = pkg_name;
+        }
+        jemStrAppendSep(&resolved,",",pkg);
+    }
+    free(names_str);
+    return(resolved.str ? resolved.str : strdup(name));
+}
+
+/**
+ * Print one or more package classpath values from the package.env file. With
+ * dependencies, multiple packages share a single resolution of their
+ * dependencies, each classpath entry is printed once.
  *
  * @param name string containing the name(s) of the package(s), 
  *             multiple comma separated package names can be specified
  */
 void jemPrintPackageClasspath(const char *name) {
-    bool package_found = false;
-    char *pkg_name = NULL;
-    char *pkgs_str = calloc(strlen(name)+1,sizeof(char));
+    bool package_found = true;
+    char *pkgs_str = jemResolvePackageNames(name);
+    if(!pkgs_str)
+        return;
+    char *pkg_name;
+    struct jem_str classpath = { NULL, 0, 0 };
+    if(jem_with_dependencies &&
+       (classpath.str = jemClasspathCacheGet(pkgs_str))) {
+        classpath.size = (classpath.len = strlen(classpath.str))+1;
+        jemPrintStr(stdout,&classpath);
+        jemStrFree(&classpath);
+        free(pkgs_str);
+        return;
+    }
+    char *key = strdup(pkgs_str);
+    struct jem_pkg **pkgs = NULL;
+    int count = 0;
     char *cursor = pkgs_str;
-    char *classpath = NULL;
-    int pkg_name_len;
-    int i;
-    memcpy(cursor,name,strlen(name));
     while((pkg_name = strsep(&cursor,","))) {
-        pkg_name_len = strlen(pkg_name);
-        for( i=0; i<pkg_name_len; i++)
-            if(pkg_name[i] == ':')
-                pkg_name[i] = '-';
         struct jem_pkg *pkg = jemPkgLoadPackage(pkg_name);
-        if(pkg) {
-            char *pkg_classpath = jemPkgGetClasspath(pkg->params);
-            package_found = true;
-            if(jem_with_dependencies) {
-                struct jem_dep *deps = jemPkgGetDeps(pkg->params);
-                if(deps) {
-                    int i;
-                    for(i=0;deps[i].name;i++) {
-                        if(deps[i].jars) {
-                            int j;
-                            for(j=0;deps[i].jars[j];j++) {
-                                if(classpath) {
-                                    char *old_cp = classpath;
-                                    asprintf(&classpath,"%s:/usr/share/%s/lib/%s",classpath,deps[i].name,deps[i].jars[j]);
-                                    free(old_cp);
-                                } else
-                                    asprintf(&classpath,"/usr/share/%s/lib/%s",deps[i].name,deps[i].jars[j]);
-                            }
-                        } else {
-                            struct jem_pkg *dep_pkg = jemPkgLoadPackage(deps[i].name);
-                            if(dep_pkg) {
-                                classpath = jemAppendStrs(classpath,":",jemPkgGetClasspath(dep_pkg->params));
-                                jemFreePkg(dep_pkg);
-                                free(dep_pkg);
-                            } else {
-                                char *msg;
-                                asprintf(&msg,"Package %s a dependency of package %s was not found!",deps[i].name,pkg_name);
-                                jemPrintError(msg);
-                                free(msg);
-                                package_found = false;
-                                break;
-                            }
-                        }
-                        jemFreeDep(&deps[i]);
-                    }
-                    free(deps);
-                }
-            }
-            classpath = jemAppendStrs(classpath,":",pkg_classpath);
-            jemFreePkg(pkg);
-            free(pkg);
-        } else {
+        if(!pkg) {
             char *msg;
             asprintf(&msg,"Package %s was not found!",pkg_name);
             jemPrintError(msg);
@@ -413,25 +613,182 @@ void jemPrintPackageClasspath(const char *name) {
             package_found = false;
             break;
         }
+        struct jem_pkg **tmp = realloc(pkgs,sizeof(struct jem_pkg *)*(count+1));
+        if(!tmp) {
+            jemPrintError("Unable to allocate memory to hold packages"); // needs to clean up and exit under error, not just print a message
+            jemFreePkg(pkg);
+            free(pkg);
+            package_found = false;
+            break;
+        }
+        pkgs = tmp;
+        pkgs[count++] = pkg;
     }
-    if(classpath) {
-        if(package_found)
-            jemPrint(stdout,classpath);
-        free(classpath);
+    if(package_found && count) {
+        if(jem_with_dependencies)
+            jemAppendPackagesDepsClasspath(&classpath,pkgs,count,key ? key : name,&package_found);
+        else {
+            int i;
+            for(i=0;i<count;i++)
+                jemStrAppendSep(&classpath,":",jemPkgGetClasspath(pkgs[i]->params));
+            jemStrDedup(&classpath,':');
+        }
+    }
+    if(classpath.str && package_found)
+        jemPrintStr(stdout,&classpath);
+    jemStrFree(&classpath);
+    int i;
+    for(i=0;i<count;i++) {
+        jemFreePkg(pkgs[i]);
+        free(pkgs[i]);
     }
+    free(pkgs);
+    free(key);
     free(pkgs_str);
 }
 
+/**
+ * Print the installed packages of one or more base package names, highest
+ * slot first, one line per base name
+ *
+ * @param name string containing the base name(s) of the package(s), multiple
+ *        comma separated base names can be specified
+ */
+void jemPrintPackageSlots(const char *name) {
+    char *names_str = strdup(name);
+    if(!names_str) {
+        jemPrintError("Unable to allocate memory to hold package names"); // needs to clean up and exit under error, not just print a message
+        return;
+    }
+    char *cursor = names_str;
+    char *base;
+    while((base = strsep(&cursor,","))) {
+        unsigned int count;
+        char **names = jemPkgGetSlots(base,&count);
+        if(!names) {
+            char *msg;
+            asprintf(&msg,"Package %s was not found!",base);
+            jemPrintError(msg);
+            free(msg);
+            continue;
+        }
+        struct jem_str slots = { NULL, 0, 0 };
+        unsigned int i;
+        for(i=0;i<count;i++)
+            jemStrAppendSep(&slots," ",names[i]);
+        if(slots.str)
+            jemPrintStr(stdout,&slots);
+        jemStrFree(&slots);
+    }
+    free(names_str);
+}
+
+/**
+ * Add the ids of all packages whose classpath includes a jar
+ *
+ * @param closure a pointer to a closure struct
+ * @param jar string containing the jar file name
+ * @param ids pointer to an array of ids, grown as needed
+ * @param count pointer to the amount of ids
+ * @return true if any package includes the jar, false otherwise
+ */
+static bool jemAddJarOwners(const struct jem_dep_closure *closure,
+                            const char *jar,
+                            size_t **ids,
+                            size_t *count) {
+    bool found = false;
+    size_t jar_len = strlen(jar);
+    size_t i;
+    for(i=0;i<closure->pkg_count;i++) {
+        const char *classpath = jemPkgGetClasspath(closure->pkgs[i].params);
+        const char *entry = classpath;
+        while(entry && *entry) {
+            const char *end = strchrnul(entry,':');
+            if((size_t)(end-entry)>=jar_len &&
+               strncmp(end-jar_len,jar,jar_len)==0 &&
+               (end-entry==(long)jar_len || end[-jar_len-1]=='/')) {
+                size_t *tmp = realloc(*ids,sizeof(size_t)*(*count+1));
+                if(tmp) {
+                    *ids = tmp;
+                    (*ids)[(*count)++] = i;
+                    found = true;
+                }
+                break;
+            }
+            entry = *end ? end+1 : end;
+        }
+    }
+    return(found);
+}
+
+/**
+ * Print the installed packages depending on one or more packages or jars, one
+ * per line. Packages depending on a jar are those depending on any package
+ * that includes the jar in its classpath.
+ *
+ * @param name string containing the name(s) of the package(s) or jar(s),
+ *             multiple comma separated names can be specified
+ */
+void jemPrintReverseDeps(const char *name) {
+    struct jem_pkg *pkgs = jemPkgLoadPackages(false);
+    enum jem_key keys[] = { JEM_KEY_DEPEND, JEM_KEY_BUILD_DEPEND, JEM_KEY_OPTIONAL_DEPEND };
+    struct jem_dep_closure *closure = jemDepClosureNewKeys(pkgs,keys,sizeof(keys)/sizeof(keys[0]));
+    char *names_str = jemResolvePackageNames(name);
+    if(!closure || !names_str) {
+        jemFreeDepClosure(closure);
+        jemFreePkgs(pkgs);
+        free(names_str);
+        return;
+    }
+    size_t *ids = NULL;
+    size_t count = 0;
+    bool found = true;
+    char *cursor = names_str;
+    char *dep_name;
+    while((dep_name = strsep(&cursor,","))) {
+        long id = jemDepClosureId(closure,dep_name);
+        if(id>=0) {
+            size_t *tmp = realloc(ids,sizeof(size_t)*(count+1));
+            if(tmp) {
+                ids = tmp;
+                ids[count++] = id;
+            }
+        } else if(!jemAddJarOwners(closure,dep_name,&ids,&count)) {
+            char *msg;
+            asprintf(&msg,"Package or jar %s was not found!",dep_name);
+            jemPrintError(msg);
+            free(msg);
+            found = false;
+        }
+    }
+    struct jem_dep *deps = found && count ?
+                           jemDepClosureDependents(closure,ids,count,jem_with_dependencies) :
+                           NULL;
+    struct jem_str out = { NULL, 0, 0 };
+    int i;
+    for(i=0;deps && deps[i].name;i++) {
+        jemStrAppendSep(&out,"\n",deps[i].name);
+        jemFreeDep(&deps[i]);
+    }
+    free(deps);
+    if(out.str)
+        jemPrintStr(stdout,&out);
+    jemStrFree(&out);
+    free(ids);
+    free(names_str);
+    jemFreeDepClosure(closure);
+    jemFreePkgs(pkgs);
+}
+
 /**
  * Print the active VM absolute path to tools.jar
  */
 void jemPrintToolsJar(void) {
-    initEnvVMs();
     struct jem_vm *avm = jemGetActiveVM(&jem_env);
     if(avm &&
        !jemVmIsBuildOnly(avm->params)) {
         char *path;
-        asprintf(&path,"%s/lib/tools.jar",jemGetValue(avm->params,"JAVA_HOME"));
+        asprintf(&path,"%s/lib/tools.jar",jemGetKey(avm->params,JEM_KEY_JAVA_HOME));
         if(path) {
             struct stat st;
             if(stat(path,&st)==0)
@@ -447,7 +804,6 @@ void jemPrintToolsJar(void) {
  * @param name string containing the name(s) of the parameter(s), multiple comma separated parameter names can be specified
  */
 void jemPrintValueFromActiveVM(const char *name) {
-    initEnvVMs();
     struct jem_vm *avm = jemGetActiveVM(&jem_env);
     if(avm) {
         char *var = NULL;
@@ -466,37 +822,266 @@ void jemPrintValueFromActiveVM(const char *name) {
 }
 
 /**
- * Print one or more parameter values from one or more package.env file
+ * Load one or more packages, each once, reading their package.env files ahead
  *
- * @param name string containing the name(s) of the package(s), multiple package(s) separated parameter names can be specified
- * @param param string containing the parameter(s) names, multiple comma separated parameter names can be specified
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified, or JEM_PKG_ALL for all
+ * @return an array of pkg structs in the order requested, or null if none.
+ *         Which must be freed using jemFreePkgs()!
  */
-void jemPrintValueFromPackage(const char *name,const char *param) {
-    char *package = NULL;
-    char *package_str = calloc(strlen(name)+1,sizeof(char));
-    char *p_cursor = package_str;
-    memcpy(p_cursor,name,strlen(name));
-    while((package = strsep(&p_cursor,","))) {
-        struct jem_pkg *pkg = jemPkgLoadPackage(package);
+static struct jem_pkg *jemLoadRequestedPackages(const char *name) {
+    if(strcmp(name,JEM_PKG_ALL)==0)
+        return(jemPkgLoadPackages(false));
+    char *pkgs_str = jemResolvePackageNames(name);
+    unsigned int count = 1;
+    const char *c;
+    for(c=pkgs_str;c && *c;c++)
+        if(*c==',')
+            count++;
+    char **names = calloc(count,sizeof(char *));
+    struct jem_pkg *pkgs = calloc(count+1,sizeof(struct jem_pkg));
+    if(!pkgs_str || !names || !pkgs) {
+        jemPrintError("Unable to allocate memory to hold packages"); // needs to clean up and exit under error, not just print a message
+        free(pkgs_str);
+        free(names);
+        free(pkgs);
+        return(NULL);
+    }
+    char *cursor = pkgs_str;
+    unsigned int i;
+    for(i=0;i<count;i++)
+        names[i] = strsep(&cursor,",");
+    struct jem_pkg_prefetch *prefetch = jemPkgPrefetch(names,count);
+    unsigned int n = 0;
+    for(i=0;i<count;i++) {
+        struct jem_pkg *pkg = jemPkgLoadPrefetched(prefetch,i,names[i]);
         if(pkg) {
-            char *var = NULL;
-            char *vars_str = calloc(strlen(param)+1,sizeof(char));
-            char *cursor = vars_str;
-            memcpy(cursor,param,strlen(param));
-            while((var = strsep(&cursor,","))) {
-                char *value = jemGetValue(pkg->params,var);
-                if(value)
-                    jemPrint(stdout,value);
-                else
-                    jemPrint(stdout,"");
-            }
-            free(vars_str);
-            jemFreePkg(pkg);
+            pkgs[n++] = *pkg;
             free(pkg);
         } else
             jemPrintError("Package not found");
     }
-    free(package_str);
+    jemPkgFreePrefetch(prefetch);
+    free(names);
+    free(pkgs_str);
+    if(!n) {
+        free(pkgs);
+        return(NULL);
+    }
+    return(pkgs);
+}
+
+/**
+ * Print one or more parameter values from one or more package.env file
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified, or JEM_PKG_ALL for all
+ * @param param string containing the parameter(s) names, multiple comma separated parameter names can be specified
+ */
+void jemPrintValueFromPackage(const char *name,const char *param) {
+    struct jem_pkg *pkgs = jemLoadRequestedPackages(name);
+    int i;
+    for(i=0;pkgs && pkgs[i].filename;i++) {
+        char *var = NULL;
+        char *vars_str = calloc(strlen(param)+1,sizeof(char));
+        char *cursor = vars_str;
+        memcpy(cursor,param,strlen(param));
+        while((var = strsep(&cursor,","))) {
+            char *value = jemGetValue(pkgs[i].params,var);
+            if(value)
+                jemPrint(stdout,value);
+            else
+                jemPrint(stdout,"");
+        }
+        free(vars_str);
+    }
+    jemFreePkgs(pkgs);
+}
+
+/**
+ * Print one or more parameter values from one or more package.env file as
+ * records of package name, parameter name and value separated by tabs, one
+ * record per line, all written at once
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified, or JEM_PKG_ALL for all
+ * @param param string containing the parameter(s) names, multiple comma separated parameter names can be specified
+ */
+void jemPrintValuesFromPackages(const char *name,const char *param) {
+    char *vars_str = strdup(param);
+    if(!vars_str) {
+        jemPrintError("Unable to allocate memory to hold parameter names"); // needs to clean up and exit under error, not just print a message
+        return;
+    }
+    unsigned int count = 1;
+    char *c;
+    for(c=vars_str;*c;c++)
+        if(*c==',')
+            count++;
+    char **vars = calloc(count,sizeof(char *));
+    if(!vars) {
+        jemPrintError("Unable to allocate memory to hold parameter names"); // needs to clean up and exit under error, not just print a message
+        free(vars_str);
+        return;
+    }
+    char *cursor = vars_str;
+    unsigned int v;
+    for(v=0;v<count;v++)
+        vars[v] = strsep(&cursor,",");
+    struct jem_pkg *pkgs = jemLoadRequestedPackages(name);
+    struct jem_str records = { NULL, 0, 0 };
+    int i;
+    for(i=0;pkgs && pkgs[i].filename;i++) {
+        for(v=0;v<count;v++) {
+            char *value = jemGetValue(pkgs[i].params,vars[v]);
+            jemStrAppendf(&records,
+                          "%s%s\t%s\t%s",
+                          records.str ? "\n" : "",
+                          pkgs[i].name,
+                          vars[v],
+                          value ? value : "");
+        }
+    }
+    if(records.str)
+        jemPrintStr(stdout,&records);
+    jemStrFree(&records);
+    jemFreePkgs(pkgs);
+    free(vars);
+    free(vars_str);
+}
+
+/**
+ * Add the VM and TARGET constraints of a package. Constraints of the form
+ * >= are kept as the highest lower bound, any others in an array. A
+ * virtual/jdk constraint requires a JDK, a virtual/jre one or a list naming
+ * both a JRE.
+ *
+ * @param params an array of param structs of the package
+ * @param lower pointer to the highest lower bound version key
+ * @param others pointer to an array of other constraints, grown as needed
+ * @param count pointer to the amount of other constraints
+ * @param jdk pointer to a bool set true if a JDK is required
+ * @param jre pointer to a bool set true if a JRE is required
+ */
+static void jemAddVMConstraints(struct jem_param *params,
+                                uint64_t *lower,
+                                struct jem_constraint **others,
+                                size_t *count,
+                                bool *jdk,
+                                bool *jre) {
+    struct jem_constraint constraint;
+    char *value = jemGetKey(params,JEM_KEY_VM);
+    if(value && strstr(value,"virtual/jre"))
+        *jre = true;
+    else if(value && strstr(value,"virtual/jdk"))
+        *jdk = true;
+    if(jemConstraintParse(&constraint,value)) {
+        if(constraint.op==JEM_CONSTRAINT_GE) {
+            if(constraint.version>*lower)
+                *lower = constraint.version;
+        } else {
+            struct jem_constraint *tmp = realloc(*others,sizeof(struct jem_constraint)*(*count+1));
+            if(tmp) {
+                *others = tmp;
+                (*others)[(*count)++] = constraint;
+            }
+        }
+    }
+    uint64_t target = jemVersionKey(jemPkgGetTarget(params),NULL);
+    if(target>*lower)
+        *lower = target;
+}
+
+/**
+ * Select the installed VM satisfying the VM and TARGET constraints of one or
+ * more packages and all their dependencies, including the JDK or JRE type it
+ * provides. Build only VMs and VMs whose JAVA_HOME does not exist are skipped
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified
+ * @param highest select the highest satisfying VM instead of the lowest
+ * @return a pointer to a vm struct, or null if none. Which must NOT be freed!
+ */
+struct jem_vm *jemSelectVM(const char *name,bool highest) {
+    initEnvVMs();
+    struct jem_pkg *pkgs = jemLoadRequestedPackages(name);
+    if(!pkgs)
+        return(NULL);
+    size_t count;
+    for(count=0;pkgs[count].filename;count++);
+    struct jem_param **params = calloc(count,sizeof(struct jem_param *));
+    if(!params) {
+        jemPrintError("Unable to allocate memory to hold packages"); // needs to clean up and exit under error, not just print a message
+        jemFreePkgs(pkgs);
+        return(NULL);
+    }
+    uint64_t lower = 0;
+    struct jem_constraint *others = NULL;
+    size_t others_count = 0;
+    bool jdk = false;
+    bool jre = false;
+    size_t i;
+    for(i=0;i<count;i++) {
+        params[i] = pkgs[i].params;
+        jemAddVMConstraints(params[i],&lower,&others,&others_count,&jdk,&jre);
+    }
+    struct jem_dep *deps = jemDepGraphResolveAll(params,count,JEM_KEY_DEPEND);
+    for(i=0;deps && deps[i].name;i++) {
+        if(deps[i].params)
+            jemAddVMConstraints(deps[i].params,&lower,&others,&others_count,&jdk,&jre);
+        jemFreeDep(&deps[i]);
+    }
+    free(deps);
+    free(params);
+    jemFreePkgs(pkgs);
+    struct jem_vm *vm = NULL;
+    int v;
+    for(v=0;jem_env.vms && jem_env.vms[v].filename;v++) {
+        struct jem_vm *candidate = &jem_env.vms[v];
+        char *home = jemGetKey(candidate->params,JEM_KEY_JAVA_HOME);
+        struct stat st;
+        if(jemVmIsBuildOnly(candidate->params) ||
+           !candidate->version ||
+           candidate->version<lower ||
+           (vm && (highest ? candidate->version<=vm->version : candidate->version>=vm->version)) ||
+           (jdk && !jemVmIsJDK(candidate->params)) ||
+           (jre && !jemVmIsJRE(candidate->params)) ||
+           !home ||
+           stat(home,&st)!=0 ||
+           !S_ISDIR(st.st_mode))
+            continue;
+        for(i=0;i<others_count;i++)
+            if(!jemConstraintMatches(&others[i],candidate->version))
+                break;
+        if(i==others_count)
+            vm = candidate;
+    }
+    free(others);
+    if(!vm) {
+        char *msg;
+        asprintf(&msg,"No installed VM satisfies the constraints of %s",name);
+        jemPrintError(msg);
+        free(msg);
+    }
+    return(vm);
+}
+
+/**
+ * Print the installed VM satisfying the constraints of one or more packages
+ * and all their dependencies, and make it the active VM
+ *
+ * @param name string containing the name(s) of the package(s), multiple comma
+ *        separated package names can be specified
+ * @param highest select the highest satisfying VM instead of the lowest
+ */
+void jemPrintVMFor(const char *name,bool highest) {
+    struct jem_vm *vm = jemSelectVM(name,highest);
+    if(vm) {
+        if(vm!=jem_env.active_vm)
+            jemFreeVirtuals();  // providers were resolved for the previous vm
+        jem_env.active_vm = vm;
+        jemPrint(stdout,jemVmGetName(vm));
+    }
 }
 
 /**
@@ -523,8 +1108,7 @@ void jemSetSystemVM(const char *vm_name) {
         jemPrintError("Only root user can set the System VM");
         return;
     }
-    initEnvVMs();
-    struct jem_vm *vm = jemVmGetVM(jem_env.vms,&(jem_env.vm_count),vm_name);
+    struct jem_vm *vm = jemGetVM(vm_name);
     if(!vm)
         jemPrintError("Could not find matching vm");
     else
@@ -541,8 +1125,7 @@ void jemSetUserVM(const char *vm_name) {
         jemPrintError("The root user can only use the System VM");
         return;
     }
-    initEnvVMs();
-    struct jem_vm *vm = jemVmGetVM(jem_env.vms,&(jem_env.vm_count),vm_name);
+    struct jem_vm *vm = jemGetVM(vm_name);
     if(!vm)
         jemPrintError("Could not find matching vm");
     else {
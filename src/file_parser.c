@@ -22,11 +22,103 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/dir.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "../include/file_parser.h"
 
+#define JEM_PARAM_SLOTS_MIN 8
+#define JEM_PARAM_STR_MIN 256
+#define JEM_DIRENTS_SIZE 32768
+
+/**
+ * Directory entry as returned by the getdents64 system call
+ */
+struct jem_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**
+ * Names of the well known keys, indexed by key id
+ */
+const char *jem_key_names[] = {
+#define JEM_KEY_NAME(name) #name,
+    JEM_KEYS(JEM_KEY_NAME)
+#undef JEM_KEY_NAME
+    NULL
+};
+
+/**
+ * Lengths of the well known key names, indexed by key id
+ */
+static const unsigned char jem_key_lens[] = {
+#define JEM_KEY_LEN(name) sizeof(#name)-1,
+    JEM_KEYS(JEM_KEY_LEN)
+#undef JEM_KEY_LEN
+};
+
+/**
+ * A parsed parameter set. The param table, a hash index over the param names
+ * and all names and values live in one allocation, the table handed out to
+ * callers is the params member.
+ */
+struct jem_param_block {
+    size_t count;               /** amount of params in the table */
+    size_t size;                /** size of the block in bytes */
+    size_t mask;                /** hash index slot mask, the slot count is a power of 2 */
+    size_t slots;               /** offset of the hash index in the block */
+    uint32_t keys[JEM_KEY_COUNT];   /** param index + 1 of each well known key, 0 if not set */
+    struct jem_param params[];  /** null terminated param table followed by the index and string arena */
+};
+
+/**
+ * Get the block a param table belongs to
+ *
+ * @param params an array of param structs returned by the parser
+ * @return a pointer to the param block
+ */
+static struct jem_param_block *jemParamBlock(struct jem_param *params) {
+    return((struct jem_param_block *)((char *)params - offsetof(struct jem_param_block,params)));
+}
+
+/**
+ * Get the hash index of a param block. Open addressing with linear probing,
+ * each slot holds a param index + 1, or 0 if empty.
+ *
+ * @param block a pointer to a param block
+ * @return a pointer to the first slot
+ */
+static uint32_t *jemParamSlots(struct jem_param_block *block) {
+    return((uint32_t *)((char *)block+block->slots));
+}
+
+/**
+ * FNV-1a hash of a param name
+ *
+ * @param name the param name, need not be null terminated
+ * @param len the length of the name
+ * @return the hash of the name
+ */
+static uint32_t jemParamHash(const char *name,size_t len) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+    for(i=0;i<len;i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return(hash);
+}
+
 /**
  * Frees the allocated memory in a array of param structs
  *
@@ -35,140 +127,521 @@
 void jemFreeParams(struct jem_param *params) {
     if(!params)
         return;
-    int i;
-    for(i=0;params[i].name;i++) {
-        free(params[i].name);
-        if(params[i].value)
-            free(params[i].value);
-    }
-    free(params);
+    free(jemParamBlock(params));
 }
 
 /**
- * Returns the value of a parameter in the array of param structs
+ * Returns the value of a parameter in the array of param structs, using the
+ * hash index built by the parser. If a name occurs more than once the first
+ * value is returned.
  *
- * @param params an array of param structs
+ * @param params an array of param structs returned by the parser
  * @param name the name of the parameter
  * @return a string containing the value. The string must NOT be freed!
  */
 char *jemGetValue(struct jem_param *params,const char *name) {
-    int i;
-    for(i=0;params[i].name;i++)
-        if(strcmp(params[i].name,name)==0)
-            return(params[i].value);
+    if(!params)
+        return(NULL);
+    struct jem_param_block *block = jemParamBlock(params);
+    uint32_t *slots = jemParamSlots(block);
+    size_t i;
+    for(i=jemParamHash(name,strlen(name)) & block->mask;
+        slots[i];
+        i=(i+1) & block->mask)
+        if(strcmp(params[slots[i]-1].name,name)==0)
+            return(params[slots[i]-1].value);
     return(NULL);
 }
 
 /**
- * Parses a config/package.env file's parameters. Storing them in an dynamically
- * allocated struct array.
+ * Returns the value of a well known parameter, recorded by the parser so no
+ * name lookup is done
  *
- * @param file the name of the file to parse
- * @return an array of param structs. Which must be freed, including struct members!
+ * @param params an array of param structs returned by the parser
+ * @param key the id of the parameter
+ * @return a string containing the value. The string must NOT be freed!
  */
-struct jem_param *jemParseFile(const char *file) {
+char *jemGetKey(struct jem_param *params,enum jem_key key) {
+    if(!params)
+        return(NULL);
+    uint32_t i = jemParamBlock(params)->keys[key];
+    if(!i)
+        return(NULL);
+    return(params[i-1].value);
+}
+
+/**
+ * Get the id of a well known key by name
+ *
+ * @param name the param name, need not be null terminated
+ * @param len the length of the name
+ * @return the key id, or JEM_KEY_COUNT if not a well known key
+ */
+static enum jem_key jemKeyId(const char *name,size_t len) {
+    int i;
+    for(i=0;i<JEM_KEY_COUNT;i++)
+        if(jem_key_lens[i]==len &&
+           memcmp(jem_key_names[i],name,len)==0)
+            break;
+    return(i);
+}
+
+/**
+ * Get the amount of parameters in an array of param structs
+ *
+ * @param params an array of param structs
+ * @return the amount of params, 0 if params is null
+ */
+size_t jemParamsCount(struct jem_param *params) {
+    if(!params)
+        return(0);
+    return(jemParamBlock(params)->count);
+}
+
+/**
+ * Adds a base address to the name and value offsets of a param block
+ *
+ * @param block a pointer to a param block holding offsets
+ * @param base the address the offsets are relative to
+ */
+static void jemParamsRelocate(struct jem_param_block *block,char *base) {
+    size_t i;
+    for(i=0;i<block->count;i++) {
+        block->params[i].name = base+(uintptr_t)block->params[i].name;
+        block->params[i].value = base+(uintptr_t)block->params[i].value;
+    }
+}
+
+/**
+ * Get the size of an array of param structs once packed by jemParamsPack()
+ *
+ * @param params an array of param structs returned by the parser
+ * @return the packed size in bytes, 0 if params is null
+ */
+size_t jemParamsPackedSize(struct jem_param *params) {
+    if(!params)
+        return(0);
+    return(jemParamBlock(params)->size);
+}
+
+/**
+ * Pack an array of param structs into a position independent copy, used to
+ * store parsed files in the index snapshot
+ *
+ * @param params an array of param structs returned by the parser
+ * @param buf buffer of at least jemParamsPackedSize() bytes
+ */
+void jemParamsPack(struct jem_param *params,void *buf) {
+    struct jem_param_block *block = jemParamBlock(params);
+    struct jem_param_block *packed = buf;
+    memcpy(packed,block,block->size);
+    size_t i;
+    for(i=0;i<block->count;i++) {
+        packed->params[i].name = (char *)(uintptr_t)(params[i].name-(char *)block);
+        packed->params[i].value = (char *)(uintptr_t)(params[i].value-(char *)block);
+    }
+}
+
+/**
+ * Check that the table, hash index and string offsets of a packed param block
+ * lie within the block, and that every string is null terminated in it
+ *
+ * @param block a pointer to a packed param block, block->size already checked
+ * @return true if the block is safe to relocate and search, false otherwise
+ */
+static bool jemParamsPackedValid(struct jem_param_block *block) {
+    size_t size = block->size;
+    size_t table = offsetof(struct jem_param_block,params);
+    size_t slot_count = block->mask+1;
+    if(block->count>=(size-table)/sizeof(struct jem_param) ||
+       block->slots<table+sizeof(struct jem_param)*(block->count+1) ||
+       block->slots>size ||
+       block->slots%sizeof(uint32_t) ||
+       !slot_count ||
+       slot_count & (slot_count-1) ||
+       slot_count<=block->count ||
+       slot_count>(size-block->slots)/sizeof(uint32_t))
+        return(false);
+    uint32_t *slots = jemParamSlots(block);
+    size_t used = 0;
+    size_t i;
+    for(i=0;i<slot_count;i++) {
+        if(slots[i]>block->count)
+            return(false);
+        if(slots[i])
+            used++;
+    }
+    if(used>block->count)   // a lookup must always reach an empty slot
+        return(false);
+    for(i=0;i<JEM_KEY_COUNT;i++)
+        if(block->keys[i]>block->count)
+            return(false);
+    char *base = (char *)block;
+    for(i=0;i<block->count;i++) {
+        uintptr_t name = (uintptr_t)block->params[i].name;
+        uintptr_t value = (uintptr_t)block->params[i].value;
+        if(name>=size || !memchr(base+name,'\0',size-name) ||
+           value>=size || !memchr(base+value,'\0',size-value))
+            return(false);
+    }
+    return(true);
+}
+
+/**
+ * Unpack a copy of an array of param structs made by jemParamsPack()
+ *
+ * @param buf the packed params
+ * @param size the packed size in bytes
+ * @return an array of param structs, or null if invalid. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParamsUnpack(const void *buf,size_t size) {
+    const struct jem_param_block *packed = buf;
+    if(size<sizeof(struct jem_param_block) ||
+       packed->size!=size)
+        return(NULL);
+    struct jem_param_block *block = malloc(size);
+    if(!block) {
+        jemPrintError("Unable to allocate memory to hold all file parameters");
+        return(NULL);
+    }
+    memcpy(block,packed,size);
+    if(!jemParamsPackedValid(block)) {
+        free(block);
+        return(NULL);
+    }
+    jemParamsRelocate(block,(char *)block);
+    block->params[block->count].name = NULL;
+    block->params[block->count].value = NULL;
+    return(block->params);
+}
+
+/**
+ * Parser state, the arena holds the param table followed by the strings.
+ * Strings are written after the table and addressed by offset until the
+ * parse is done, as the arena may move when it grows.
+ */
+struct jem_parser {
+    char *arena;        /** param block being built */
+    size_t table_size;  /** bytes used by block header, param table and hash index */
+    size_t used;        /** bytes used in the arena */
+    size_t size;        /** bytes allocated for the arena */
+    size_t count;       /** amount of params stored */
+};
+
+/**
+ * Get a param from the table under construction
+ */
+static struct jem_param *jemParserParam(struct jem_parser *p,size_t i) {
+    return(&((struct jem_param_block *)p->arena)->params[i]);
+}
+
+/**
+ * Make sure the arena has room for len more bytes
+ *
+ * @return true on success, false if out of memory
+ */
+static bool jemParserReserve(struct jem_parser *p,size_t len) {
+    if(p->used+len<=p->size)
+        return(true);
+    size_t size = p->size*2;
+    while(size<p->used+len)
+        size *= 2;
+    char *arena = realloc(p->arena,size);
+    if(!arena)
+        return(false);
+    p->arena = arena;
+    p->size = size;
+    return(true);
+}
+
+/**
+ * Find the hash index slot of a param name in the block under construction
+ *
+ * @return a pointer to the slot holding the name, or the empty slot to use
+ */
+static uint32_t *jemParserSlot(struct jem_parser *p,const char *name,size_t name_len) {
+    struct jem_param_block *block = (struct jem_param_block *)p->arena;
+    uint32_t *slots = jemParamSlots(block);
+    size_t i;
+    for(i=jemParamHash(name,name_len) & block->mask;
+        slots[i];
+        i=(i+1) & block->mask) {
+        const char *pname = p->arena+(uintptr_t)jemParserParam(p,slots[i]-1)->name;
+        if(strncmp(pname,name,name_len)==0 && pname[name_len]=='\0')
+            break;
+    }
+    return(&slots[i]);
+}
+
+/**
+ * Returns the value of an already parsed param, used for ${VAR} expansion
+ *
+ * @return offset of the value in the arena, 0 if not found
+ */
+static size_t jemParserLookup(struct jem_parser *p,const char *name,size_t name_len) {
+    uint32_t *slot = jemParserSlot(p,name,name_len);
+    if(!*slot)
+        return(0);
+    return((uintptr_t)jemParserParam(p,*slot-1)->value);
+}
+
+/**
+ * Append bytes to the arena
+ *
+ * @return true on success, false if out of memory
+ */
+static bool jemParserAppend(struct jem_parser *p,const char *str,size_t len) {
+    if(!jemParserReserve(p,len))
+        return(false);
+    memcpy(p->arena+p->used,str,len);
+    p->used += len;
+    return(true);
+}
+
+/**
+ * Store a value in the arena, expanding ${VAR}s from previously parsed params.
+ * Expansion stops at the first unknown variable, the rest is kept as is.
+ *
+ * @return true on success, false if out of memory
+ */
+static bool jemParserStoreValue(struct jem_parser *p,const char *value,size_t value_len) {
+    const char *end = value+value_len;
+    const char *cursor = value;
+    while(cursor<end) {
+        const char *var = memmem(cursor,end-cursor,"${",2);
+        const char *var_end = var ? memchr(var,'}',end-var) : NULL;
+        size_t var_value = 0;
+        if(var_end)
+            var_value = jemParserLookup(p,var+2,var_end-var-2);
+        if(!var_value)
+            break;
+        // the arena may move while appending, copy the var value by offset
+        size_t var_value_len = strlen(p->arena+var_value);
+        if(!jemParserAppend(p,cursor,var-cursor) ||
+           !jemParserReserve(p,var_value_len))
+            return(false);
+        memcpy(p->arena+p->used,p->arena+var_value,var_value_len);
+        p->used += var_value_len;
+        cursor = var_end+1;
+    }
+    return(jemParserAppend(p,cursor,end-cursor) &&
+           jemParserAppend(p,"",1));
+}
+
+/**
+ * Parses a config/package.env file's parameters from a memory buffer.
+ * Storing them in a single dynamically allocated block, along with a hash
+ * index of the param names for jemGetValue().
+ *
+ * @param buf the file contents
+ * @param len the length of the file contents
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParseBuffer(const char *buf,size_t len) {
+    const char *end = buf+len;
+    const char *line;
+    size_t lines = 1;
+    for(line=buf;(line = memchr(line,'\n',end-line));line++)
+        lines++;
+    size_t slot_count = JEM_PARAM_SLOTS_MIN;
+    while(slot_count<lines*2)
+        slot_count *= 2;
+    struct jem_parser p;
+    size_t slots = sizeof(struct jem_param_block) + sizeof(struct jem_param)*(lines+1);
+    p.table_size = slots + sizeof(uint32_t)*slot_count;
+    p.size = p.table_size + len + lines*2 + JEM_PARAM_STR_MIN;
+    p.used = p.table_size;
+    p.count = 0;
+    if(!(p.arena = malloc(p.size))) {
+        jemPrintError("Unable to allocate memory to hold all file parameters"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    struct jem_param_block *block = (struct jem_param_block *)p.arena;
+    block->mask = slot_count-1;
+    block->slots = slots;
+    memset(block->keys,0,sizeof(block->keys));
+    memset(jemParamSlots(block),0,sizeof(uint32_t)*slot_count);
+    for(line=buf;line<end;) {
+        const char *eol = memchr(line,'\n',end-line);
+        if(!eol)
+            eol = end;
+        const char *next = eol+1;
+        const char *value;
+        if(line[0]=='#' ||
+           !(value = memchr(line,'=',eol-line))) {
+            line = next;
+            continue;
+        }
+        const char *name = line;
+        size_t name_len = value-line;
+        value++;
+        if(value<eol && value[0]=='"') {
+            value++;
+            if(value<eol && eol[-1]=='"')
+                eol--;
+        }
+        size_t name_off = p.used;
+        if(!jemParserAppend(&p,name,name_len) ||
+           !jemParserAppend(&p,"",1)) {
+            jemPrintError("Unable to allocate memory to hold all file parameter names"); // needs to clean up and exit under error, not just print a message
+            break;
+        }
+        size_t value_off = p.used;
+        if(!jemParserStoreValue(&p,value,eol-value)) {
+            jemPrintError("Unable to allocate memory to hold all file parameter values"); // needs to clean up and exit under error, not just print a message
+            break;
+        }
+        struct jem_param *param = jemParserParam(&p,p.count);
+        param->name = (char *)(uintptr_t)name_off;
+        param->value = (char *)(uintptr_t)value_off;
+        p.count++;
+        uint32_t *slot = jemParserSlot(&p,p.arena+name_off,name_len);
+        if(!*slot) {   // first occurrence of a name wins, as with a linear search
+            *slot = p.count;
+            enum jem_key key = jemKeyId(name,name_len);
+            if(key<JEM_KEY_COUNT)
+                ((struct jem_param_block *)p.arena)->keys[key] = p.count;
+        }
+        line = next;
+    }
+    if(!p.count) {
+        free(p.arena);
+        return(NULL);
+    }
+    char *arena = realloc(p.arena,p.used);   // give back unused arena space
+    if(arena)
+        p.arena = arena;
+    block = (struct jem_param_block *)p.arena;
+    block->params[p.count].name = NULL;
+    block->params[p.count].value = NULL;
+    block->count = p.count;
+    block->size = p.used;
+    jemParamsRelocate(block,p.arena);
+    return(block->params);
+}
+
+/**
+ * Parses an open config/package.env file's parameters. Storing them in a
+ * single dynamically allocated block. The file is memory mapped while parsing.
+ *
+ * @param fd an open file descriptor of the file, which is NOT closed
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParseFd(int fd) {
     struct jem_param *params = NULL;
-    FILE *fp = fopen(file,"r");
-    if(!fp) {
+    struct stat st;
+    if(fstat(fd,&st)<0 || !S_ISREG(st.st_mode)) {
+        jemPrintError("Invalid file, not a regular file"); // needs to be changed to throw an exception
+        return(params);
+    }
+    if(st.st_size>0) {
+        void *buf = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        if(buf!=MAP_FAILED) {
+            params = jemParseBuffer(buf,st.st_size);
+            munmap(buf,st.st_size);
+        } else
+            jemPrintError("Unable to map file into memory"); // needs to be changed to throw an exception
+    }
+    return(params);
+}
+
+/**
+ * Parses a config/package.env file's parameters, relative to an open
+ * directory. Storing them in a single dynamically allocated block.
+ *
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param file the name of the file to parse, relative to dirfd
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParseFileAt(int dirfd,const char *file) {
+    int fd = openat(dirfd,file,O_RDONLY|O_CLOEXEC);
+    if(fd<0) {
         if(errno==EACCES)
             jemPrintError("File not readable"); // needs to be changed to throw an exception
         else
             jemPrintError("Invalid file, does not exist"); // needs to be changed to throw an exception
-        return(params);
+        return(NULL);
     }
-    short bytes_read = 0;
-    char *line = NULL;
-    size_t line_size = 0;
-    int i = 0;
-    char *var_name = NULL;      // ${VAR} name in a paramter value, global to for speedy re-use
-    char *var_value = NULL;     // ${VAR} value to replace the variable in paramter value
-    int var_value_len = 0;
-    while((bytes_read = getline(&line,&line_size,fp))>0 && !feof(fp)) {
-        if(!line)
-            continue;
-        char *value = NULL;     // value of a parameter in a config/env file
-        if(strlen(line)>0 && line[0]!='#') {
-            if(!(value = strchr(line,'=')))
-                continue;
-            value++;
-            int value_len = strlen(value);
-            int name_len = bytes_read - value_len;
-            if(value_len<=0)
+    struct jem_param *params = jemParseFd(fd);
+    close(fd);
+    return(params);
+}
+
+/**
+ * Parses a config/package.env file's parameters. Storing them in a single
+ * dynamically allocated block. The file is memory mapped while parsing.
+ *
+ * @param file the name of the file to parse
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemParseFile(const char *file) {
+    return(jemParseFileAt(AT_FDCWD,file));
+}
+
+/**
+ * Get the names of all entries of an open directory, except . and .. Entries
+ * are read in large batches with getdents64.
+ *
+ * @param dirfd an open directory file descriptor, read from its current offset
+ * @param count set to the amount of names
+ * @return an array of strings, the array and strings are a single allocation,
+ *         or null on error. The array must be freed, strings must NOT be freed!
+ */
+char **jemGetDirNames(int dirfd,unsigned int *count) {
+    *count = 0;
+    char *dirents = malloc(JEM_DIRENTS_SIZE);
+    char *strs = NULL;
+    size_t used = 0;
+    size_t size = 0;
+    long len = -1;
+    while(dirents &&
+          (len = syscall(SYS_getdents64,dirfd,dirents,JEM_DIRENTS_SIZE))>0) {
+        long off;
+        for(off=0;off<len;) {
+            struct jem_dirent64 *dirent = (struct jem_dirent64 *)(dirents+off);
+            off += dirent->d_reclen;
+            if(!strcmp(dirent->d_name,".") ||
+               !strcmp(dirent->d_name,".."))
                 continue;
-            if(value[0]=='"') {
-                value++;
-                value_len-=2;
-                memset(line+bytes_read-1,'\0',1); // end the string in case extra data in buffer
-            }
-            struct jem_param *nparams = realloc(params,sizeof(struct jem_param)*(i+3));
-            if(!nparams) {
-                jemPrintError("Unable to allocate memory to hold all file parameters"); // needs to clean up and exit under error, not just print a message
-                break;
-            }
-            params = nparams;
-            params[i+1].name = NULL;
-            params[i+1].value = NULL;
-            params[i].name = calloc(name_len,sizeof(char));
-            if(!params[i].name) {
-                jemPrintError("Unable to allocate memory to hold all file parameter names"); // needs to clean up and exit under error, not just print a message
-                break;
-            }
-            memcpy(params[i].name,line,name_len-1);
-            params[i].value = NULL;
-            // Expand ${VAR} before storing value
-            char *subptr = value;
-            int cur_len = 0;
-            while((subptr = strstr(subptr,"${"))) {
-                char *endstr = strstr(subptr,"}");
-                int end_len = strlen(endstr);
-                int sub_len = strlen(subptr);
-                int var_len = sub_len - end_len - 1;
-                end_len -= 2;
-                // Re-use var/value if same, if not get new var name/value
-                if(!var_name ||
-                   strncasecmp(var_name,subptr+2,var_len-1)) {
-                    if(var_name)
-                        free(var_name);
-                    var_name = calloc(var_len,sizeof(char));
-                    if(!var_name) {
-                        jemPrintError("Unable to allocate memory to hold all file parameter variable name"); // needs to clean up and exit under error, not just print a message
-                        break;
-                    }
-                    memcpy(var_name,subptr+2,var_len-1);
-                    var_value = jemGetValue(params,var_name);
-                    if(!var_value)
-                        break;
-                    var_value_len = strlen(var_value);
-                }
-                value_len += var_value_len - var_len - 2;
-                char *tmp = realloc(params[i].value,(value_len+1) * sizeof(char));
+            size_t name_len = strlen(dirent->d_name)+1;
+            if(used+name_len>size) {
+                size_t nsize = size ? size*2 : JEM_DIRENTS_SIZE;
+                while(used+name_len>nsize)
+                    nsize *= 2;
+                char *tmp = realloc(strs,nsize);
                 if(!tmp) {
-                    jemPrintError("Unable to re-allocate memory while parsing file parameter variables"); // needs to clean up and exit under error, not just print a message
+                    len = -1;
                     break;
                 }
-                params[i].value = tmp;
-                if(cur_len>0)
-                    cur_len -= sub_len-1;                                       // back up so we overwrite/start where the next variable starts
-                memcpy(params[i].value+cur_len,var_value,var_value_len);        // store var value
-                memcpy(params[i].value+cur_len+var_value_len,endstr+1,end_len); // store end of unmodified str to modify
-                memset(params[i].value+cur_len+var_value_len+end_len,'\0',1);   // end the string in case extra data in buffer
-                cur_len += var_value_len + end_len;
-                subptr = endstr+1;
-            }
-            // No ${VAR}s store value as is
-            if(!params[i].value) {
-                params[i].value = calloc(value_len,sizeof(char));
-                if(!params[i].value)
-                    jemPrintError("Unable to allocate memory to hold all file parameter values"); // needs to clean up and exit under error, not just print a message
-                memcpy(params[i].value,value,value_len-1);
+                strs = tmp;
+                size = nsize;
             }
-            i++;
+            memcpy(strs+used,dirent->d_name,name_len);
+            used += name_len;
+            (*count)++;
         }
-        memset(line,'\0',line_size);
+        if(len<0)
+            break;
     }
-    if(var_name)
-        free(var_name);
-    free(line);
-    fclose(fp);
-    return(params);
+    char **names = NULL;
+    if(len==0 && (names = malloc(sizeof(char *)*(*count+1)+used))) {
+        char *str = used ? memcpy(names+*count+1,strs,used) : NULL;
+        unsigned int i;
+        for(i=0;i<*count;i++) {
+            names[i] = str;
+            str += strlen(str)+1;
+        }
+        names[i] = NULL;
+    } else {
+        jemPrintError("Unable to read directory entries"); // needs to be changed to throw an exception
+        *count = 0;
+    }
+    free(strs);
+    free(dirents);
+    return(names);
 }
@@ -0,0 +1,513 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#include "../include/io_batch.h"
+
+#ifdef HAVE_IO_URING
+#define JEM_IO_SLOTS 256        /** most files in flight, each uses a registered file slot */
+#define JEM_IO_READ_SIZE 16384  /** bytes read per file, larger files are read again */
+
+/**
+ * Operations linked for each file, in submission order
+ */
+enum jem_io_op {
+    JEM_IO_STATX,
+    JEM_IO_OPENAT,
+    JEM_IO_READ,
+    JEM_IO_CLOSE,
+    JEM_IO_OPS
+};
+
+/**
+ * A mapped io_uring submission and completion queue
+ */
+struct jem_io_ring {
+    int fd;                         /** ring file descriptor, -1 if not in use */
+    void *sq_ptr;                   /** mapped submission queue ring */
+    size_t sq_size;
+    void *cq_ptr;                   /** mapped completion queue ring, may be sq_ptr */
+    size_t cq_size;
+    struct io_uring_sqe *sqes;      /** mapped submission queue entries */
+    size_t sqes_size;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned int queued;            /** entries queued but not yet submitted */
+};
+
+static int jem_io_uring_state = 0;  /** 0 unknown, 1 available, -1 not available */
+#endif
+
+/**
+ * Pending reads of a batch of files
+ */
+struct jem_io_batch {
+    int dirfd;                  /** directory the file names are relative to */
+    struct jem_io_file *files;  /** files to read */
+    unsigned int count;         /** amount of files */
+#ifdef HAVE_IO_URING
+    struct jem_io_ring ring;    /** ring, fd -1 when reading with plain system calls */
+    struct statx *stx;          /** statx results, indexed as files */
+    unsigned char *ops;         /** completed operations, indexed as files */
+    unsigned int *file_slots;   /** registered file slot, indexed as files */
+    unsigned int *slots;        /** stack of free registered file slots */
+    unsigned int slot_count;    /** amount of registered file slots */
+    unsigned int free;          /** amount of free slots */
+    unsigned int next;          /** next file to queue */
+#endif
+};
+
+/**
+ * Read a file relative to an open directory with plain system calls
+ *
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param file pointer to the file to read
+ */
+static void jemIoReadFile(int dirfd,struct jem_io_file *file) {
+    file->buf = NULL;
+    file->size = 0;
+    file->error = 0;
+    memset(&file->st,0,sizeof(file->st));
+    int fd = openat(dirfd,file->name,O_RDONLY|O_CLOEXEC);
+    if(fd<0)
+        file->error = errno;
+    else {
+        if(fstat(fd,&file->st)<0)
+            file->error = errno;
+        else if(!S_ISREG(file->st.st_mode))
+            file->error = EINVAL;
+        else if(file->st.st_size>0 && !(file->buf = malloc(file->st.st_size)))
+            file->error = ENOMEM;
+        while(file->buf && file->size<(size_t)file->st.st_size) {
+            ssize_t len = read(fd,file->buf+file->size,file->st.st_size-file->size);
+            if(len<=0) {
+                if(len<0)
+                    file->error = errno;
+                break;
+            }
+            file->size += len;
+        }
+        close(fd);
+    }
+    file->done = true;
+}
+
+#ifdef HAVE_IO_URING
+/**
+ * Unmap and close a ring
+ *
+ * @param ring pointer to a ring
+ */
+static void jemIoRingClose(struct jem_io_ring *ring) {
+    if(ring->sqes && ring->sqes!=MAP_FAILED)
+        munmap(ring->sqes,ring->sqes_size);
+    if(ring->cq_ptr && ring->cq_ptr!=MAP_FAILED && ring->cq_ptr!=ring->sq_ptr)
+        munmap(ring->cq_ptr,ring->cq_size);
+    if(ring->sq_ptr && ring->sq_ptr!=MAP_FAILED)
+        munmap(ring->sq_ptr,ring->sq_size);
+    if(ring->fd>=0)
+        close(ring->fd);
+    memset(ring,0,sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * Set up a ring, and register a table of empty file slots for files opened
+ * directly into the ring
+ *
+ * @param ring pointer to a ring
+ * @param entries the amount of submission queue entries
+ * @param slots the amount of file slots
+ * @return true if the ring is ready, false otherwise
+ */
+static bool jemIoRingSetup(struct jem_io_ring *ring,unsigned int entries,unsigned int slots) {
+    struct io_uring_params p;
+    memset(ring,0,sizeof(*ring));
+    memset(&p,0,sizeof(p));
+    ring->fd = syscall(__NR_io_uring_setup,entries,&p);
+    if(ring->fd<0)
+        return(false);
+    ring->sq_size = p.sq_off.array+p.sq_entries*sizeof(unsigned int);
+    ring->cq_size = p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_size>ring->sq_size)
+            ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+    ring->sq_ptr = mmap(NULL,ring->sq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                        ring->fd,IORING_OFF_SQ_RING);
+    if(ring->sq_ptr==MAP_FAILED) {
+        jemIoRingClose(ring);
+        return(false);
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ptr = ring->sq_ptr;
+    else
+        ring->cq_ptr = mmap(NULL,ring->cq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                            ring->fd,IORING_OFF_CQ_RING);
+    ring->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL,ring->sqes_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                      ring->fd,IORING_OFF_SQES);
+    if(ring->cq_ptr==MAP_FAILED || ring->sqes==MAP_FAILED) {
+        jemIoRingClose(ring);
+        return(false);
+    }
+    ring->sq_tail = (unsigned int *)((char *)ring->sq_ptr+p.sq_off.tail);
+    ring->sq_mask = (unsigned int *)((char *)ring->sq_ptr+p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)((char *)ring->sq_ptr+p.sq_off.array);
+    ring->cq_head = (unsigned int *)((char *)ring->cq_ptr+p.cq_off.head);
+    ring->cq_tail = (unsigned int *)((char *)ring->cq_ptr+p.cq_off.tail);
+    ring->cq_mask = (unsigned int *)((char *)ring->cq_ptr+p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr+p.cq_off.cqes);
+    int *fds = malloc(sizeof(int)*slots);
+    bool registered = false;
+    if(fds) {
+        unsigned int i;
+        for(i=0;i<slots;i++)
+            fds[i] = -1;    // sparse, filled by direct opens
+        registered = syscall(__NR_io_uring_register,ring->fd,IORING_REGISTER_FILES,fds,slots)==0;
+        free(fds);
+    }
+    if(!registered)
+        jemIoRingClose(ring);
+    return(registered);
+}
+
+/**
+ * Get the next free submission queue entry, cleared
+ *
+ * @param ring pointer to a ring
+ * @param user_data value returned with the completion of the entry
+ * @return pointer to the entry
+ */
+static struct io_uring_sqe *jemIoRingSqe(struct jem_io_ring *ring,uint64_t user_data) {
+    unsigned int tail = *ring->sq_tail;
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe,0,sizeof(*sqe));
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail,tail+1,__ATOMIC_RELEASE);
+    ring->queued++;
+    return(sqe);
+}
+
+/**
+ * Queue the linked statx, openat, read and close of files while file slots
+ * are free. The read and close are hard linked so the slot is always closed.
+ *
+ * @param batch pointer to a batch
+ */
+static void jemIoQueue(struct jem_io_batch *batch) {
+    while(batch->free && batch->next<batch->count) {
+        unsigned int i = batch->next++;
+        struct jem_io_file *file = &batch->files[i];
+        unsigned int slot = batch->slots[--batch->free];
+        batch->file_slots[i] = slot;
+        uint64_t user_data = (uint64_t)i*JEM_IO_OPS;
+        file->buf = malloc(JEM_IO_READ_SIZE);
+        struct io_uring_sqe *sqe = jemIoRingSqe(&batch->ring,user_data+JEM_IO_STATX);
+        sqe->opcode = IORING_OP_STATX;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = batch->dirfd;
+        sqe->addr = (uintptr_t)file->name;
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (uintptr_t)&batch->stx[i];
+        sqe = jemIoRingSqe(&batch->ring,user_data+JEM_IO_OPENAT);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = batch->dirfd;
+        sqe->addr = (uintptr_t)file->name;
+        sqe->open_flags = O_RDONLY;     // direct descriptors never leak over exec
+        sqe->file_index = slot+1;
+        sqe = jemIoRingSqe(&batch->ring,user_data+JEM_IO_READ);
+        sqe->opcode = IORING_OP_READ;
+        sqe->flags = IOSQE_FIXED_FILE|IOSQE_IO_HARDLINK;
+        sqe->fd = slot;
+        sqe->addr = (uintptr_t)file->buf;
+        sqe->len = file->buf ? JEM_IO_READ_SIZE : 0;
+        sqe = jemIoRingSqe(&batch->ring,user_data+JEM_IO_CLOSE);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = slot+1;
+    }
+}
+
+/**
+ * Finish a file once all its operations completed. Files that failed for
+ * any reason other than not existing or not being readable, or that are
+ * larger than the read size, are read again with plain system calls.
+ *
+ * @param batch pointer to a batch
+ * @param i the index of the file
+ */
+static void jemIoComplete(struct jem_io_batch *batch,unsigned int i) {
+    struct jem_io_file *file = &batch->files[i];
+    struct statx *stx = &batch->stx[i];
+    if(!file->error) {
+        file->st.st_mode = stx->stx_mode;
+        file->st.st_ino = stx->stx_ino;
+        file->st.st_size = stx->stx_size;
+        file->st.st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+        file->st.st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+    }
+    if(file->error==EINVAL || file->error==EOPNOTSUPP)
+        jem_io_uring_state = -1;    // statx or direct opens not supported
+    if((file->error && file->error!=ENOENT && file->error!=ENOTDIR && file->error!=EACCES) ||
+       (!file->error && stx->stx_size!=file->size)) {
+        free(file->buf);
+        jemIoReadFile(batch->dirfd,file);
+    } else if(!file->size) {
+        free(file->buf);
+        file->buf = NULL;
+    } else {
+        char *buf = realloc(file->buf,file->size);
+        if(buf)
+            file->buf = buf;
+    }
+    file->done = true;
+}
+
+/**
+ * Submit queued operations and handle completions, until a file has been read
+ *
+ * @param batch pointer to a batch
+ * @param file pointer to the file to wait for, or null to wait for all files
+ */
+static void jemIoReap(struct jem_io_batch *batch,struct jem_io_file *file) {
+    struct jem_io_ring *ring = &batch->ring;
+    while(file ? !file->done : batch->free<batch->slot_count || batch->next<batch->count) {
+        int ret = syscall(__NR_io_uring_enter,ring->fd,ring->queued,1,IORING_ENTER_GETEVENTS,NULL,0);
+        if(ret<0) {
+            if(errno==EINTR)
+                continue;
+            jemPrintError("Unable to wait for batched file reads"); // needs to clean up and exit under error, not just print a message
+            unsigned int i;
+            for(i=0;i<batch->count;i++) {
+                if(batch->files[i].done)
+                    continue;
+                batch->files[i].buf = NULL;     // may still be written, not freed
+                jemIoReadFile(batch->dirfd,&batch->files[i]);
+            }
+            batch->free = batch->slot_count;
+            batch->next = batch->count;
+            return;
+        }
+        ring->queued -= ret;
+        unsigned int head = *ring->cq_head;
+        unsigned int tail = __atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE);
+        for(;head!=tail;head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            unsigned int i = cqe->user_data/JEM_IO_OPS;
+            enum jem_io_op op = cqe->user_data%JEM_IO_OPS;
+            struct jem_io_file *f = &batch->files[i];
+            if(op==JEM_IO_READ && cqe->res>=0)
+                f->size = cqe->res;
+            else if(cqe->res<0 && op!=JEM_IO_CLOSE &&
+                    (!f->error || (f->error==ECANCELED && cqe->res!=-ECANCELED)))
+                f->error = -cqe->res;
+            if(++batch->ops[i]==JEM_IO_OPS) {    // every linked operation completes, even when canceled
+                batch->slots[batch->free++] = batch->file_slots[i];
+                jemIoComplete(batch,i);
+            }
+        }
+        __atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE);
+        jemIoQueue(batch);
+    }
+}
+#endif
+
+/**
+ * Check if file reads are batched through io_uring, a batch is read with
+ * plain system calls when io_uring is not built in or not available
+ *
+ * @return true if io_uring is built in and not known to be unavailable
+ */
+bool jemIoAvailable(void) {
+#ifdef HAVE_IO_URING
+    return(jem_io_uring_state>=0);
+#else
+    return(false);
+#endif
+}
+
+/**
+ * Start reading a batch of files relative to an open directory. Each file is
+ * stat'ed, opened, read and closed. With io_uring the operations run in the
+ * kernel while the caller continues, otherwise files are read on wait.
+ *
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param files array of files to read, which must outlive the batch
+ * @param count the amount of files in the array
+ * @return a batch, or null if the files were already read. Which must be
+ *         freed using jemIoWait()!
+ */
+struct jem_io_batch *jemIoSubmit(int dirfd,struct jem_io_file *files,unsigned int count) {
+    unsigned int i;
+    for(i=0;i<count;i++) {
+        files[i].buf = NULL;
+        files[i].size = 0;
+        files[i].error = 0;
+        files[i].done = false;
+        memset(&files[i].st,0,sizeof(files[i].st));
+    }
+    struct jem_io_batch *batch = NULL;
+    if(!count || !(batch = calloc(1,sizeof(struct jem_io_batch)))) {
+        for(i=0;i<count;i++)
+            jemIoReadFile(dirfd,&files[i]);
+        return(NULL);
+    }
+    batch->dirfd = dirfd;
+    batch->files = files;
+    batch->count = count;
+#ifdef HAVE_IO_URING
+    batch->ring.fd = -1;
+    if(jem_io_uring_state<0)
+        return(batch);
+    batch->slot_count = count<JEM_IO_SLOTS ? count : JEM_IO_SLOTS;
+    batch->stx = calloc(count,sizeof(struct statx));
+    batch->ops = calloc(count,sizeof(unsigned char));
+    batch->file_slots = calloc(count,sizeof(unsigned int));
+    batch->slots = calloc(batch->slot_count,sizeof(unsigned int));
+    if(!batch->stx || !batch->ops || !batch->file_slots || !batch->slots)
+        return(batch);
+    if(!jemIoRingSetup(&batch->ring,batch->slot_count*JEM_IO_OPS,batch->slot_count)) {
+        jem_io_uring_state = -1;
+        return(batch);
+    }
+    jem_io_uring_state = 1;
+    for(i=0;i<batch->slot_count;i++)
+        batch->slots[i] = batch->slot_count-1-i;
+    batch->free = batch->slot_count;
+    jemIoQueue(batch);
+    int ret = syscall(__NR_io_uring_enter,batch->ring.fd,batch->ring.queued,0,0,NULL,0);
+    if(ret>0)
+        batch->ring.queued -= ret;
+#endif
+    return(batch);
+}
+
+/**
+ * Wait until a file of a batch has been read
+ *
+ * @param batch a batch returned by jemIoSubmit(), may be null
+ * @param i the index of the file in the batch's array
+ */
+void jemIoWaitFile(struct jem_io_batch *batch,unsigned int i) {
+    if(!batch || i>=batch->count || batch->files[i].done)
+        return;
+#ifdef HAVE_IO_URING
+    if(batch->ring.fd>=0) {
+        jemIoReap(batch,&batch->files[i]);
+        return;
+    }
+#endif
+    jemIoReadFile(batch->dirfd,&batch->files[i]);
+}
+
+/**
+ * Wait until all files of a batch have been read, and free the batch
+ *
+ * @param batch a batch returned by jemIoSubmit(), may be null
+ */
+void jemIoWait(struct jem_io_batch *batch) {
+    if(!batch)
+        return;
+#ifdef HAVE_IO_URING
+    if(batch->ring.fd>=0) {
+        jemIoReap(batch,NULL);
+        jemIoRingClose(&batch->ring);
+    }
+    free(batch->stx);
+    free(batch->ops);
+    free(batch->file_slots);
+    free(batch->slots);
+#endif
+    unsigned int i;
+    for(i=0;i<batch->count;i++)
+        if(!batch->files[i].done)
+            jemIoReadFile(batch->dirfd,&batch->files[i]);
+    free(batch);
+}
+
+/**
+ * Read a batch of files relative to an open directory
+ *
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param files array of files to read
+ * @param count the amount of files in the array
+ */
+void jemIoReadFiles(int dirfd,struct jem_io_file *files,unsigned int count) {
+    jemIoWait(jemIoSubmit(dirfd,files,count));
+}
+
+/**
+ * Frees the contents of an array of read files, not the array itself
+ *
+ * @param files array of files
+ * @param count the amount of files in the array
+ */
+void jemIoFreeFiles(struct jem_io_file *files,unsigned int count) {
+    unsigned int i;
+    for(i=0;files && i<count;i++) {
+        free(files[i].buf);
+        files[i].buf = NULL;
+    }
+}
+
+/**
+ * Parses a read config/package.env file's parameters, printing an error as
+ * jemParseFile() does if the file could not be read
+ *
+ * @param file pointer to a read file
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemIoParseFile(const struct jem_io_file *file) {
+    if(file->st.st_mode && !S_ISREG(file->st.st_mode)) {
+        jemPrintError("Invalid file, not a regular file"); // needs to be changed to throw an exception
+        return(NULL);
+    }
+    if(file->error==EACCES)
+        jemPrintError("File not readable"); // needs to be changed to throw an exception
+    else if(file->error==ENOENT || file->error==ENOTDIR)
+        jemPrintError("Invalid file, does not exist"); // needs to be changed to throw an exception
+    else if(file->error)
+        jemPrintError("Unable to read file"); // needs to be changed to throw an exception
+    if(file->error || !file->buf)
+        return(NULL);
+    return(jemParseBuffer(file->buf,file->size));
+}
@@ -30,6 +30,14 @@
 #define JEM_OPT_SELECT_VM -10
 #define JEM_OPT_PACKAGE -20
 #define JEM_OPT_VIRT_PROVIDERS -30
+#define JEM_OPT_NO_CACHE -40
+#define JEM_OPT_UPDATE_CACHE -50
+#define JEM_OPT_JOBS -60
+#define JEM_OPT_BATCH -70
+#define JEM_OPT_RDEPEND -80
+#define JEM_OPT_VM_FOR -90
+#define JEM_OPT_VM_POLICY -100
+#define JEM_OPT_SLOTS -110
 
 const char *argp_program_version = JEM_VERSION_STR;
 const char *argp_program_bug_address = JEM_CONTACT;
@@ -42,9 +50,14 @@ static char args_doc[] = "";
 static struct argp_option options[] = {
     {0,0,0,0,"Global Options:"},
     {"nocolor", 'n', 0, 0, "Disable color output"},
+    {"jobs", JEM_OPT_JOBS, "JOBS", 0, "Amount of threads parsing package files, defaults to JEM_JOBS or the amount of processors"},
+    {"no-cache", JEM_OPT_NO_CACHE, 0, 0, "Do not use or write the package and VM index snapshot"},
+    {"update-cache", JEM_OPT_UPDATE_CACHE, 0, 0, "Rebuild the package and VM index snapshot"},
     {0,0,0,0,"VM Options:", 2},
     {"active-vm", 'a', "VM",  0, "Use this vm instead of the active vm when returning information", 2},
     {"select-vm", 'a', 0,  OPTION_ALIAS},
+    {"vm-for", JEM_OPT_VM_FOR, "PACKAGE(s)", 0, "Print and use the installed VM satisfying the VM and TARGET constraints of these packages and their dependencies", 2},
+    {"vm-policy", JEM_OPT_VM_POLICY, "POLICY", 0, "lowest or highest satisfying VM selected by a following --vm-for, defaults to lowest", 2},
     {"java", 'J', 0, 0, "Print the location of the java executable", 2},
     {"javac", 'c', 0, 0, "Print the location of the javac executable", 2},
     {"jar", 'j', 0, 0, "Print the location of the jar executable", 2},
@@ -64,11 +77,14 @@ static struct argp_option options[] = {
     {0,0,0,0,"Package Options:", 3},
     {"list-packages", 'l', 0, 0, "List all available packages on the system", 3},
     {"list-available-packages", 'l', 0, OPTION_ALIAS},
-    {"with-dependencies", 'd', 0, 0, "Include package dependencies in --classpath and --library calls", 3},
+    {"with-dependencies", 'd', 0, 0, "Include package dependencies in --classpath and --library calls, and indirect dependents in --rdepend calls", 3},
     {"classpath", 'p', "PACKAGE(s)", 0, "Print entries in the environment classpath for these packages", 3},
-    {"package", JEM_OPT_PACKAGE, "PACKAGE(s)", 0, "Retrieve a value from a package(s) package.env file, value is specified by --query", 3},
+    {"slots", JEM_OPT_SLOTS, "PACKAGE(s)", 0, "Print the installed packages of these base package names, highest slot first", 3},
+    {"package", JEM_OPT_PACKAGE, "PACKAGE(s)", 0, "Retrieve a value from a package(s) package.env file, value is specified by --query, * for all packages", 3},
     {"query", 'q', "PARAM(s)", 0, "Parameter(s) value(s) to retrieve from package(s) package.env file, specified by --package", 3},
+    {"batch", JEM_OPT_BATCH, 0, 0, "Print --package --query values as tab separated package, parameter and value records", 3},
     {"library", 'i', "LIBRARY(s)", 0, "Print java library paths for these packages", 3},
+    {"rdepend", JEM_OPT_RDEPEND, "PACKAGE(s)", 0, "Print packages that depend on these packages or jars", 3},
     {"get-virtual-providers", JEM_OPT_VIRT_PROVIDERS, "PACKAGE(S)", 0, "Return a list of packages that provide a virtual", 3},
     {0,0,0,0,"GNU Options:", 4},
     {0}
@@ -76,13 +92,28 @@ static struct argp_option options[] = {
 
 struct args {
     bool color;
+    bool batch;         /** print --package --query values as records */
+    bool highest_vm;    /** --vm-for selects the highest satisfying vm */
+    char *package;      /** --package argument */
+    char *query;        /** --query argument */
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    struct args *args = state->input;
     switch(key) {
         case 'a':
-            initEnvVMs();
-            jem_env.active_vm = jemVmGetVM(jem_env.vms,&(jem_env.vm_count),arg);
+            jem_env.active_vm = jemGetVM(arg);
+            break;
+        case JEM_OPT_VM_FOR:
+            jemPrintVMFor(arg,args->highest_vm);
+            break;
+        case JEM_OPT_VM_POLICY:
+            if(!strcmp(arg,"highest"))
+                args->highest_vm = true;
+            else if(!strcmp(arg,"lowest"))
+                args->highest_vm = false;
+            else
+                jemPrintError("--vm-policy must be lowest or highest");
             break;
         case 'd':
             jem_with_dependencies = true;
@@ -90,6 +121,16 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case 'n':
             jem_color_output = false;
             break;
+        case JEM_OPT_JOBS:
+            jem_jobs = strtoul(arg,NULL,10);
+            break;
+        case JEM_OPT_NO_CACHE:
+            jem_use_cache = false;
+            break;
+        case JEM_OPT_UPDATE_CACHE:
+            if(!jemSnapshotUpdate())
+                jemPrintError("Unable to write index snapshot to any cache directory");
+            return(1);
         case 'J':
             jemPrintExe("java");
             return(1);
@@ -133,13 +174,14 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             jemPrintPackageClasspath(arg);
             return(1);
         case 'q':
-            if(state->argv[4])
-                jemPrintValueFromPackage(state->argv[4],arg);
-            return(1);
+            args->query = arg;
+            break;
         case JEM_OPT_PACKAGE:
-            if(state->argv[4])
-                jemPrintValueFromPackage(arg,state->argv[4]);
-            return(1);
+            args->package = arg;
+            break;
+        case JEM_OPT_BATCH:
+            args->batch = true;
+            break;
         case 'i':
             jemPrintValueFromPackage(arg,"LIBRARY_PATH");
             return(1);
@@ -150,12 +192,27 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case 'o':
             jemPrintValueFromActiveVM("JAVA_HOME");
             return(1);
+        case JEM_OPT_SLOTS:
+            jemPrintPackageSlots(arg);
+            return(1);
+        case JEM_OPT_RDEPEND:
+            jemPrintReverseDeps(arg);
+            return(1);
         case JEM_OPT_VIRT_PROVIDERS:
             jemPrintVirtualProviders(arg);
             return(1);
         case ARGP_KEY_NO_ARGS:
             if(!state->argv[1])
                 argp_usage(state);
+            break;
+        case ARGP_KEY_END:
+            if(args->package && args->query) {
+                if(args->batch)
+                    jemPrintValuesFromPackages(args->package,args->query);
+                else
+                    jemPrintValueFromPackage(args->package,args->query);
+            } else if(args->package || args->query)
+                jemPrintError("--package and --query must be used together");
             return(1);
         default:
             return ARGP_ERR_UNKNOWN;
@@ -168,6 +225,7 @@ struct jem_env jem_env;
 
 int main(int argc, char **argv) {
     struct args args;
+    memset(&args,0,sizeof(args));
     args.color = true;
 
     jemInitEnv(&jem_env);
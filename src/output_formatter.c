@@ -21,10 +21,16 @@
  *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <libintl.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <unistd.h>
 #include "../include/output_formatter.h"
 
+#define JEM_STR_MIN 64
+
 bool jem_color_output = true;
 bool jem_auto_indent = true;
 bool jem_exit_status = EXIT_SUCCESS;
@@ -117,19 +123,191 @@ char *jemAddTermColor(char *msg) {
  * @return a string containing the two strings with separator. The string must be freed!
  */
 char *jemAppendStrs(char* cur_str,char *sep_str,char *add_str) {
-    char *new_str = NULL;
-    if(add_str) {
-        if(cur_str) {
-            char *old_str = cur_str;
-            if(sep_str)
-                asprintf(&new_str,"%s%s%s",cur_str,sep_str,add_str);
-            else
-                asprintf(&new_str,"%s%s",cur_str,add_str);
-            free(old_str);
-        } else
-            asprintf(&new_str,"%s",add_str);
+    if(!add_str)
+        return(cur_str);
+    struct jem_str str = { cur_str, 0, 0 };
+    if(cur_str)
+        str.size = (str.len = strlen(cur_str))+1;
+    if(!jemStrAppendSep(&str,sep_str ? sep_str : "",add_str)) {
+        jemStrFree(&str);
+        return(NULL);
+    }
+    return(str.str);
+}
+
+/**
+ * Make sure a string builder has room for len more characters
+ *
+ * @param str pointer to a string builder
+ * @param len the amount of characters to make room for
+ * @return true if there is room, false if out of memory
+ */
+bool jemStrReserve(struct jem_str *str,size_t len) {
+    if(str->len+len<str->size)
+        return(true);
+    size_t size = str->size ? str->size*2 : JEM_STR_MIN;
+    while(size<=str->len+len)
+        size *= 2;
+    char *tmp = realloc(str->str,size);
+    if(!tmp) {
+        jemPrintError("Unable to allocate memory to hold string"); // needs to clean up and exit under error, not just print a message
+        return(false);
+    }
+    if(!str->str)
+        tmp[0] = '\0';
+    str->str = tmp;
+    str->size = size;
+    return(true);
+}
+
+/**
+ * Append characters to a string builder
+ *
+ * @param str pointer to a string builder
+ * @param add the characters to append
+ * @param len the amount of characters to append
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppendN(struct jem_str *str,const char *add,size_t len) {
+    if(!jemStrReserve(str,len))
+        return(false);
+    memcpy(str->str+str->len,add,len);
+    str->len += len;
+    str->str[str->len] = '\0';
+    return(true);
+}
+
+/**
+ * Append a string to a string builder
+ *
+ * @param str pointer to a string builder
+ * @param add string to append, may be null
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppend(struct jem_str *str,const char *add) {
+    if(!add)
+        return(true);
+    return(jemStrAppendN(str,add,strlen(add)));
+}
+
+/**
+ * Append a string to a string builder, preceded by a separator unless the
+ * builder is empty
+ *
+ * @param str pointer to a string builder
+ * @param sep_str a non-null string separator
+ * @param add string to append, nothing is appended if null
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppendSep(struct jem_str *str,const char *sep_str,const char *add) {
+    if(!add)
+        return(true);
+    if(str->str && !jemStrAppend(str,sep_str))
+        return(false);
+    return(jemStrAppend(str,add));
+}
+
+/**
+ * Append a formatted string to a string builder, formatted in place
+ *
+ * @param str pointer to a string builder
+ * @param fmt printf format
+ * @return true if appended, false if out of memory
+ */
+bool jemStrAppendf(struct jem_str *str,const char *fmt,...) {
+    va_list ap;
+    va_start(ap,fmt);
+    int len = vsnprintf(str->str ? str->str+str->len : NULL,
+                        str->str ? str->size-str->len : 0,fmt,ap);
+    va_end(ap);
+    if(len<0)
+        return(false);
+    if(str->str && str->len+len<str->size) {
+        str->len += len;
+        return(true);
     }
-    return(new_str);
+    if(!jemStrReserve(str,len))
+        return(false);
+    va_start(ap,fmt);
+    vsnprintf(str->str+str->len,str->size-str->len,fmt,ap);
+    va_end(ap);
+    str->len += len;
+    return(true);
+}
+
+/**
+ * Remove repeated entries from a separated list in a string builder, keeping
+ * the first occurrence of each, empty entries are removed as well
+ *
+ * @param str pointer to a string builder
+ * @param sep the entry separator character
+ */
+void jemStrDedup(struct jem_str *str,char sep) {
+    if(!str->str)
+        return;
+    size_t entries = 1;
+    size_t i;
+    for(i=0;i<str->len;i++)
+        if(str->str[i]==sep)
+            entries++;
+    size_t size = JEM_STR_MIN;
+    while(size<entries*2)
+        size *= 2;
+    struct { size_t offset; size_t len; } *slots = calloc(size,sizeof(*slots));  // kept entries, len 0 if free
+    if(!slots)
+        return;
+    size_t len = 0;
+    size_t start = 0;
+    while(start<=str->len) {
+        char *entry = str->str+start;
+        char *end = memchr(entry,sep,str->len-start);
+        size_t entry_len = end ? (size_t)(end-entry) : str->len-start;
+        start += entry_len+1;
+        if(!entry_len)
+            continue;
+        uint32_t hash = 2166136261u;
+        for(i=0;i<entry_len;i++)
+            hash = (hash ^ (unsigned char)entry[i]) * 16777619u;
+        size_t s;
+        for(s=hash & (size-1);slots[s].len;s=(s+1) & (size-1))
+            if(slots[s].len==entry_len &&
+               memcmp(str->str+slots[s].offset,entry,entry_len)==0)
+                break;
+        if(slots[s].len)
+            continue;
+        if(len)
+            str->str[len++] = sep;
+        memmove(str->str+len,entry,entry_len);
+        slots[s].offset = len;
+        slots[s].len = entry_len;
+        len += entry_len;
+    }
+    free(slots);
+    str->len = len;
+    str->str[len] = '\0';
+}
+
+/**
+ * Take the string out of a string builder, leaving it empty
+ *
+ * @param str pointer to a string builder
+ * @return the string, or null if nothing was appended. The string must be freed!
+ */
+char *jemStrDetach(struct jem_str *str) {
+    char *s = str->str;
+    str->str = NULL;
+    str->len = 0;
+    str->size = 0;
+    return(s);
+}
+
+/**
+ * Frees the string of a string builder, leaving it empty
+ *
+ * @param str pointer to a string builder
+ */
+void jemStrFree(struct jem_str *str) {
+    free(jemStrDetach(str));
 }
 
 /**
@@ -190,6 +368,29 @@ void jemPrint(FILE *stream, char *msg) {
     free(cmsg);
 }
 
+/**
+ * Print the contents of a string builder followed by a newline, with a single
+ * write and no terminal codes
+ *
+ * @param stream the stream to print to
+ * @param str pointer to a string builder, the newline is appended to it
+ */
+void jemPrintStr(FILE *stream,struct jem_str *str) {
+    if(!jemStrAppendN(str,"\n",1))
+        return;
+    fflush(stream);
+    size_t off = 0;
+    while(off<str->len) {
+        ssize_t len = write(fileno(stream),str->str+off,str->len-off);
+        if(len<0) {
+            if(errno==EINTR)
+                continue;
+            break;
+        }
+        off += len;
+    }
+}
+
 /**
  * Print a message with colors and formatting
  *
@@ -206,20 +407,17 @@ void jemPrintMsg(FILE *stream,
     bool color = jemIsValidTerm();
     if(title)
         msg = jemIndent(title,msg);
-    char *pmsg;
+    struct jem_str pmsg = { NULL, 0, 0 };
     if(preffix && color)
-        asprintf(&pmsg,"%s%s",preffix,msg);
-    else
-        asprintf(&pmsg,"%s",msg);
+        jemStrAppend(&pmsg,preffix);
+    jemStrAppend(&pmsg,msg);
     if(title)
         free(msg);
-    if(suffix && color) {
-        char *tmp_msg = pmsg;
-        asprintf(&pmsg,"%s%s",pmsg,suffix);
-        free(tmp_msg);
-    }
-    jemPrint(stream,pmsg);
-    free(pmsg);
+    if(suffix && color)
+        jemStrAppend(&pmsg,suffix);
+    if(pmsg.str)
+        jemPrint(stream,pmsg.str);
+    jemStrFree(&pmsg);
 }
 
 /**
@@ -21,15 +21,72 @@
  *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/dir.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include "../include/dep_graph.h"
 #include "../include/env_manager.h"
 
 bool jem_with_dependencies = false;
+unsigned int jem_jobs = 0;
+
+static struct jem_virtual *jem_virtuals = NULL;
+static int jem_virtuals_count = -1;     /** -1 until virtuals are loaded */
+static uint64_t jem_virtuals_vm_version = 0;    /** active vm version key, 0 if none */
+static bool jem_virtuals_vm_loaded = false; /** active vm version looked up */
+static pthread_mutex_t jem_virtuals_vm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Sorted jar names of a package's lib directory, cached per process
+ */
+struct jem_jar_listing {
+    char *name;                         /** package name, null if the slot is empty */
+    char **jars;                        /** sorted jar names, the array and strings are a single allocation */
+    int error;                          /** errno if the lib directory could not be read, 0 otherwise */
+    struct jem_snapshot_stamp stamp;    /** stamp of the lib directory when read */
+};
+
+static struct jem_jar_listing *jem_jar_listings = NULL;  /** open addressing hash table */
+static size_t jem_jar_listings_size = 0;                 /** amount of slots, a power of 2 */
+static size_t jem_jar_listings_count = 0;                /** amount of used slots */
+static char ***jem_jar_retired = NULL;                   /** replaced listings, freed on cleanup */
+static size_t jem_jar_retired_count = 0;
+static pthread_mutex_t jem_jar_listings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Installed package names sharing a base name, package directories are named
+ * base-slot, or base for the default slot
+ */
+struct jem_pkg_slots {
+    char *base;             /** base name, null if the hash slot is empty */
+    char **names;           /** package names, highest slot first */
+    unsigned int count;     /** amount of names */
+};
+
+static struct jem_pkg_slots *jem_pkg_bases = NULL;  /** open addressing hash table of base names */
+static char **jem_pkg_names = NULL;                 /** open addressing hash set of package names */
+static size_t jem_pkg_slots_size = 0;               /** amount of hash slots of both, a power of 2, 0 until loaded */
+static pthread_mutex_t jem_pkg_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Shared state of the package loading threads
+ */
+struct jem_pkg_loader {
+    char **names;           /** package or virtual names */
+    struct jem_pkg **pkgs;  /** loaded packages, indexed as names */
+    unsigned int count;     /** amount of names */
+    unsigned int next;      /** next name to load */
+    bool virtual;           /** load virtual instead of package.env files */
+    int dirfd;              /** open package or virtual directory, or AT_FDCWD */
+    struct jem_io_file *files;  /** files read ahead, indexed as names, or null */
+    pthread_mutex_t lock;   /** guards next */
+};
 
 /**
  * Frees the allocated memory used by a dep struct
@@ -41,6 +98,8 @@ void jemFreeDep(struct jem_dep *dep) {
         return;
     if(dep->name)
          free(dep->name);
+    free(dep->filename);
+    jemFreeParams(dep->params);
     if(!dep->jars)
         return;
     int i;
@@ -78,6 +137,59 @@ void jemFreePkgs(struct jem_pkg *pkgs) {
     free(pkgs);
 }
 
+/**
+ * Frees the process wide cache of virtual packages
+ */
+void jemFreeVirtuals(void) {
+    int i;
+    for(i=0;i<jem_virtuals_count;i++) {
+        free(jem_virtuals[i].name);
+        free(jem_virtuals[i].conf_providers);
+        free(jem_virtuals[i].providers);
+    }
+    free(jem_virtuals);
+    jem_virtuals = NULL;
+    jem_virtuals_count = -1;
+    jem_virtuals_vm_loaded = false;
+}
+
+/**
+ * Frees the process wide cache of package jar names
+ */
+void jemFreeJarNames(void) {
+    size_t i;
+    for(i=0;i<jem_jar_listings_size;i++) {
+        free(jem_jar_listings[i].name);
+        free(jem_jar_listings[i].jars);
+    }
+    for(i=0;i<jem_jar_retired_count;i++)
+        free(jem_jar_retired[i]);
+    free(jem_jar_listings);
+    free(jem_jar_retired);
+    jem_jar_listings = NULL;
+    jem_jar_listings_size = 0;
+    jem_jar_listings_count = 0;
+    jem_jar_retired = NULL;
+    jem_jar_retired_count = 0;
+}
+
+/**
+ * Frees the process wide index of package slots
+ */
+void jemFreePkgSlots(void) {
+    size_t i;
+    for(i=0;i<jem_pkg_slots_size;i++) {
+        free(jem_pkg_bases[i].base);
+        free(jem_pkg_bases[i].names);
+        free(jem_pkg_names[i]);
+    }
+    free(jem_pkg_bases);
+    free(jem_pkg_names);
+    jem_pkg_bases = NULL;
+    jem_pkg_names = NULL;
+    jem_pkg_slots_size = 0;
+}
+
 /**
  * Get a package's description
  *
@@ -85,7 +197,7 @@ void jemFreePkgs(struct jem_pkg *pkgs) {
  * @return a string containing the value. The string must NOT be freed!
  */
 char *jemPkgGetDescription(struct jem_param *params) {
-    char *desc = jemGetValue(params,"DESCRIPTION");
+    char *desc = jemGetKey(params,JEM_KEY_DESCRIPTION);
     if(desc)
         return(desc);
     return("No Description");
@@ -98,186 +210,130 @@ char *jemPkgGetDescription(struct jem_param *params) {
  * @return a string containing the value. The string must NOT be freed!
  */
 char *jemPkgGetClasspath(struct jem_param *params) {
-    return(jemGetValue(params,"CLASSPATH"));
+    return(jemGetKey(params,JEM_KEY_CLASSPATH));
+}
+
+/**
+ * FNV-1a hash of a package name
+ */
+static size_t jemPkgHashName(const char *name) {
+    uint32_t hash = 2166136261u;
+    for(;*name;name++)
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return(hash);
 }
 
 /**
- * Get a packages jar names
+ * Find the jar listing slot of a package, growing the table when needed
  *
  * @param pkg_name string name of the package
- * @return a string array containing the value. The string must be freed!
+ * @return a pointer to the slot holding the package, or the empty slot to
+ *         use, or null if out of memory
  */
-char **jemPkgGetJarNames(char *pkg_name) {
-    DIR *dp = NULL;
-    char **jars = NULL;
-    int i = 0;
-    char *path = NULL;
-    asprintf(&path,"%s%s/lib",JEM_USER_SHARE,pkg_name);
-    if(!path) {
-        jemPrintError("Unable to allocate memory to hold package jar names");
-        return(NULL);
-    }    
-    if((dp = opendir(path))) {
-        struct dirent *file;
-        while((file = readdir(dp))) {
-            if(!strcmp(file->d_name,".") ||
-               !strcmp(file->d_name,".."))
+static struct jem_jar_listing *jemPkgJarListing(const char *pkg_name) {
+    if((jem_jar_listings_count+1)*2>jem_jar_listings_size) {
+        size_t size = jem_jar_listings_size ? jem_jar_listings_size*2 : 64;
+        struct jem_jar_listing *listings = calloc(size,sizeof(struct jem_jar_listing));
+        if(!listings) {
+            jemPrintError("Unable to allocate memory to hold package jar names"); // needs to clean up and exit under error, not just print a message
+            return(NULL);
+        }
+        size_t i;
+        for(i=0;i<jem_jar_listings_size;i++) {
+            if(!jem_jar_listings[i].name)
                 continue;
-            char **tmp = realloc(jars,sizeof(char *)*(i+2));
-            if(tmp) {
-                jars = tmp;
-                jars[i+1] = NULL;
-                asprintf(&jars[i],"%s",file->d_name);
-                i++;
-            } else
-                jemPrintError("Unable to allocate memory to hold package jar names");
+            size_t j = jemPkgHashName(jem_jar_listings[i].name) & (size-1);
+            while(listings[j].name)
+                j = (j+1) & (size-1);
+            listings[j] = jem_jar_listings[i];
         }
-    } else {
-        if(errno==EACCES)
-            jemPrintError("Package directory not readable");
-        else
-            jemPrintError("Invalid package directory");
+        free(jem_jar_listings);
+        jem_jar_listings = listings;
+        jem_jar_listings_size = size;
     }
-    free(path);
-    if(dp)
-        closedir(dp);
-    if(jars)
-        qsort(jars,i,sizeof(char *),jemPkgCmpJarNames);
-    return(jars);
+    size_t i = jemPkgHashName(pkg_name) & (jem_jar_listings_size-1);
+    while(jem_jar_listings[i].name && strcmp(jem_jar_listings[i].name,pkg_name))
+        i = (i+1) & (jem_jar_listings_size-1);
+    return(&jem_jar_listings[i]);
 }
 
 /**
- * Compares the names of two jars, used soley by qsort in jemPkgGetJarNames()
+ * Read and sort the jar names of a package's lib directory
  *
- * @return an integer -1, 0, or 1.
+ * @param listing pointer to the listing to fill in
+ * @param path the lib directory name
  */
-int jemPkgCmpJarNames(const void *v1, const void *v2) {
-    return strcmp(v1,v2);
+static void jemPkgReadJarNames(struct jem_jar_listing *listing,const char *path) {
+    listing->jars = NULL;
+    listing->error = 0;
+    int dirfd = open(path,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if(dirfd<0) {
+        listing->error = errno;
+        return;
+    }
+    unsigned int count;
+    char **jars = jemGetDirNames(dirfd,&count);
+    close(dirfd);
+    if(jars && count)
+        qsort(jars,count,sizeof(char *),jemPkgCmpJarNames);
+    else {
+        free(jars);
+        jars = NULL;
+    }
+    listing->jars = jars;
 }
 
 /**
- * Get a package's dependencies, internal function called buy wrappers
+ * Get a packages jar names. Listings are cached per process, a package's lib
+ * directory is read again only when its stamp changed.
  *
- * @param params an array of param structs
- * @name string containing the variable name, DEPEND/BUILD_DEPEND/OPTIONAL_DEPEND
- * @return an array of dep structs. Which must be freed, including struct members!
+ * @param pkg_name string name of the package
+ * @return a string array containing the value, sorted. The array and strings
+ *         must NOT be freed, they remain valid until jemFreeJarNames()!
  */
-struct jem_dep *_jemPkgGetDeps(struct jem_dep *deps,
-                         struct jem_param *params,
-                         char *name) {
-    char *value = jemGetValue(params,name);
-    if(!value)
-        return(deps);
-    char *dep_name = NULL;
-    char *deps_str = calloc(strlen(value)+1,sizeof(char));
-    char *cursor = deps_str;
-    memcpy(cursor,value,strlen(value));
-    int i = 0;
-    while((dep_name = strsep(&cursor,":"))) {
-        bool has_jar = false;
-        char *pkg_name = dep_name;
-        if((pkg_name = strstr(pkg_name,"@"))) {
-            pkg_name++; // skip @
-            memset(dep_name+strlen(dep_name)-strlen(pkg_name)-1,'\0',1); // set dep_name to jar name
-            if(strstr(jemPkgGetClasspath(params),dep_name))
-                continue;            
-            has_jar = true;
-        } else 
-            pkg_name = dep_name; // re-assign since null
-        if(deps) {
-            for(i=0;deps[i].name;i++) {
-                if(strcmp(deps[i].name,pkg_name)==0) {
-                    if(!deps[i].jars && has_jar)
-                        has_jar = false;
-                    goto ADDJARS;
-                }
-            }
-        }
-        struct jem_dep *tmp = realloc(deps,sizeof(struct jem_dep)*(i+2));
-        if(!tmp) {
-            jemPrintError("Unable to allocate memory to hold all dependencies"); // needs to clean up and exit under error, not just print a message
-            free(deps_str);
-            return(deps);
-        }
-        deps = tmp;
-        deps[i+1].name = NULL;
-        deps[i+1].jars = NULL;
-        deps[i+1].parsed_sub_deps = false;
-        deps[i].jars = NULL;
-        asprintf(&(deps[i].name),"%s",pkg_name);
-        if(!deps[i].name) {
-            jemPrintError("Unable to allocate memory to hold dependency name"); // needs to clean up and exit under error, not just print a message
-            free(deps_str);
-            return(deps);
-        }
-        deps[i].parsed_sub_deps = false;
-        ADDJARS:
-        if(!has_jar) {
-            if(deps[i].jars) {
-                char **jars = jemPkgGetJarNames(pkg_name);
-                if(jars) {
-                    int j;
-                    int k;
-                    for(j=0;jars[j];j++) {
-                        bool exists = false;
-                        for(k=0;deps[i].jars[k];k++)
-                            if(strcmp(jars[j],deps[i].jars[k])==0)
-                                exists = true;
-                        if(!exists) {
-                            char **tmp_jars = realloc(deps[i].jars,sizeof(char *)*(k+2));
-                            if(!tmp_jars)
-                                jemPrintError("Unable to allocate memory to hold all dependency jars");
-                            deps[i].jars = tmp_jars;
-                            deps[i].jars[k+1]= NULL;
-                            asprintf(&(deps[i].jars[k]),"%s",jars[j]);
-                            if(!deps[i].jars[k])
-                                jemPrintError("Unable to allocate memory to hold dependency jar");
-                        }
-                        free(jars[j]);
-                    }
-                    free(jars);
-                }
-            }
-            continue;
-        }
-        int j = 0;
-        bool jar_added = false;
-        if(deps[i].jars) {
-            for(j=0;deps[i].jars[j];j++) {
-                if(strcmp(deps[i].jars[j],dep_name)==0)
-                    jar_added = true;
-            }
-        }
-        if(jar_added)
-            continue;
-        char **tmp_jars = realloc(deps[i].jars,sizeof(char *)*(j+2));
-        if(!tmp_jars) {
-            jemPrintError("Unable to allocate memory to hold all dependency jars"); // needs to clean up and exit under error, not just print a message
-            free(deps_str);
-            return(deps);
-        }
-        deps[i].jars = tmp_jars;
-        deps[i].jars[j+1]= NULL;
-        asprintf(&(deps[i].jars[j]),"%s",dep_name);
-        if(!deps[i].jars[j]) {
-            jemPrintError("Unable to allocate memory to hold dependency jar"); // needs to clean up and exit under error, not just print a message
-            free(deps_str);
-            return(deps);
-        }
+char **jemPkgGetJarNames(char *pkg_name) {
+    char path[PATH_MAX];
+    if(snprintf(path,sizeof(path),"%s%s/lib",JEM_USER_SHARE,pkg_name)>=(int)sizeof(path)) {
+        jemPrintError("Invalid package directory");
+        return(NULL);
     }
-    if(deps) {
-        for(i=0;deps[i].name && !deps[i].parsed_sub_deps;i++) {
-            deps[i].parsed_sub_deps = true;
-            struct jem_pkg *pkg = jemPkgLoadPackage(deps[i].name);
-            if(pkg) {
-                deps = _jemPkgGetDeps(deps,pkg->params,name);
-                jemFreePkg(pkg);
-                free(pkg);
-            }
+    struct jem_snapshot_stamp stamp;
+    jemSnapshotStampFile(&stamp,path);
+    pthread_mutex_lock(&jem_jar_listings_lock);
+    struct jem_jar_listing *listing = jemPkgJarListing(pkg_name);
+    if(listing && !listing->name) {
+        if((listing->name = strdup(pkg_name))) {
+            jem_jar_listings_count++;
+            jemPkgReadJarNames(listing,path);
+            listing->stamp = stamp;
+        } else
+            listing = NULL;
+    } else if(listing && memcmp(&listing->stamp,&stamp,sizeof(stamp))) {
+        char ***retired = realloc(jem_jar_retired,sizeof(char **)*(jem_jar_retired_count+1));
+        if(retired) {   // callers may still hold the old listing
+            jem_jar_retired = retired;
+            jem_jar_retired[jem_jar_retired_count++] = listing->jars;
+            jemPkgReadJarNames(listing,path);
+            listing->stamp = stamp;
         }
     }
-    free(deps_str);
-    return(deps);
+    char **jars = listing ? listing->jars : NULL;
+    int error = listing ? listing->error : 0;
+    pthread_mutex_unlock(&jem_jar_listings_lock);
+    if(error==EACCES)
+        jemPrintError("Package directory not readable");
+    else if(error)
+        jemPrintError("Invalid package directory");
+    return(jars);
+}
+
+/**
+ * Compares the names of two jars, used soley by qsort in jemPkgGetJarNames()
+ *
+ * @return an integer -1, 0, or 1.
+ */
+int jemPkgCmpJarNames(const void *v1, const void *v2) {
+    return strcmp(*(char * const *)v1,*(char * const *)v2);
 }
 
 /**
@@ -287,8 +343,7 @@ struct jem_dep *_jemPkgGetDeps(struct jem_dep *deps,
  * @return an array of dep structs. Which must be freed, including struct members!
  */
 struct jem_dep *jemPkgGetDeps(struct jem_param *params) {
-    struct jem_dep *deps = NULL;
-    return(_jemPkgGetDeps(deps,params,"DEPEND"));
+    return(jemDepGraphResolve(params,JEM_KEY_DEPEND));
 }
 
 /**
@@ -298,8 +353,7 @@ struct jem_dep *jemPkgGetDeps(struct jem_param *params) {
  * @return an array of dep structs. Which must be freed, including struct members!
  */
 struct jem_dep *jemPkgGetBuildDeps(struct jem_param *params) {
-    struct jem_dep *deps = NULL;
-    return(_jemPkgGetDeps(deps,params,"BUILD_DEPEND"));
+    return(jemDepGraphResolve(params,JEM_KEY_BUILD_DEPEND));
 }
 
 /**
@@ -309,8 +363,7 @@ struct jem_dep *jemPkgGetBuildDeps(struct jem_param *params) {
  * @return an array of dep structs. Which must be freed, including struct members!
  */
 struct jem_dep *jemPkgGetOptDeps(struct jem_param *params) {
-    struct jem_dep *deps = NULL;
-    return(_jemPkgGetDeps(deps,params,"OPTIONAL_DEPEND"));
+    return(jemDepGraphResolve(params,JEM_KEY_OPTIONAL_DEPEND));
 }
 
 /**
@@ -320,7 +373,7 @@ struct jem_dep *jemPkgGetOptDeps(struct jem_param *params) {
  * @return an array of strings containing the value. The array and strings must be freed!
  */
 char **jemPkgGetProvides(struct jem_param *params) {
-    char *value = jemGetValue(params,"PROVIDES");
+    char *value = jemGetKey(params,JEM_KEY_PROVIDES);
     if(!value)
         return(NULL);
     char *provide = NULL;
@@ -350,62 +403,261 @@ char **jemPkgGetProvides(struct jem_param *params) {
  * @return a string containing the value. The string must be freed!
  */
 char *jemPkgGetTarget(struct jem_param *params) {
-    return(jemGetValue(params,"TARGET"));
+    return(jemGetKey(params,JEM_KEY_TARGET));
 }
 
 /**
- * Get active package for virtual
+ * Split a providers value into a null terminated array, the array and strings
+ * are a single allocation. An empty value results in an empty array.
  *
- * @param virtual string containing the name of the virtual
- * @return a string containing the value. The string must be freed!
+ * @param value string containing the providers
+ * @param delim the providers separator
+ * @return an array of strings. Which must be freed, strings must NOT be freed!
  */
-char *jemPkgGetActiveVirtualProvider(const char *virtual) {
-    char *package = NULL;
-    char *providers = NULL;
-    struct jem_param *conf = jemParseFile(JEM_PKG_VIRTUAL_CONFIG);
-    if(conf) {
-        int i;
-        for(i=0;conf[i].name;i++) {
-            if(strcmp(virtual,conf[i].name)==0) {
-                asprintf(&providers,"%s",conf[i].value);
-                break;
+static char **jemPkgSplitProviders(const char *value,char delim) {
+    size_t len = strlen(value);
+    size_t count = len ? 1 : 0;
+    const char *c;
+    for(c=value;*c;c++)
+        if(*c==delim)
+            count++;
+    char **providers = malloc(sizeof(char *)*(count+1)+len+1);
+    if(!providers) {
+        jemPrintError("Unable to allocate memory to hold virtual providers"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    char *str = memcpy(providers+count+1,value,len+1);
+    size_t i = 0;
+    if(len) {
+        providers[i++] = str;
+        for(;*str;str++) {
+            if(*str==delim) {
+                *str = '\0';
+                providers[i++] = str+1;
             }
         }
-        jemFreeParams(conf);
-    }
-    if(!providers)
-        providers = jemPkgGetVirtualProviders(virtual,false);
-    if(!providers)
-        return(package);
-    else if(strcmp(providers,"")==0)
-        return(providers);
-    char *provider = NULL;
-    char *provider_str = calloc(strlen(providers)+1,sizeof(char));
-    char *p_cursor = provider_str;
-    memcpy(p_cursor,providers,strlen(providers));
-    while((provider = strsep(&p_cursor,","))) {
+    }
+    providers[i] = NULL;
+    return(providers);
+}
+
+/**
+ * Get or add a virtual to the process wide cache while loading
+ *
+ * @param name string containing the name of the virtual
+ * @return a pointer to a virtual struct, or null on error
+ */
+static struct jem_virtual *jemPkgAddVirtual(const char *name) {
+    int i;
+    for(i=0;i<jem_virtuals_count;i++)
+        if(strcmp(jem_virtuals[i].name,name)==0)
+            return(&jem_virtuals[i]);
+    struct jem_virtual *tmp = realloc(jem_virtuals,sizeof(struct jem_virtual)*(i+1));
+    if(!tmp) {
+        jemPrintError("Unable to allocate memory to hold all virtuals"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    jem_virtuals = tmp;
+    memset(&jem_virtuals[i],0,sizeof(struct jem_virtual));
+    jem_virtuals[i].name = strdup(name);
+    if(!jem_virtuals[i].name) {
+        jemPrintError("Unable to allocate memory to hold virtual name"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    jem_virtuals_count++;
+    return(&jem_virtuals[i]);
+}
+
+/**
+ * Compares the names of two virtuals, used soley by qsort and bsearch on the
+ * process wide cache of virtuals
+ *
+ * @return an integer -1, 0, or 1.
+ */
+static int jemPkgCompareVirtuals(const void *v1, const void *v2) {
+    const struct jem_virtual *virt1 = v1;
+    const struct jem_virtual *virt2 = v2;
+    return(strcmp(virt1->name,virt2->name));
+}
+
+/**
+ * Loads virtuals.conf and all virtuals.d files into the process wide cache
+ */
+static void jemPkgLoadVirtuals(void) {
+    jem_virtuals_count = 0;
+    struct jem_param *conf = jemSnapshotParseFile(JEM_PKG_VIRTUAL_CONFIG);
+    int i;
+    for(i=0;conf && conf[i].name;i++) {
+        struct jem_virtual *v = jemPkgAddVirtual(conf[i].name);
+        if(v && !v->conf_providers)     // first entry wins
+            v->conf_providers = jemPkgSplitProviders(conf[i].value,',');
+    }
+    jemFreeParams(conf);
+    unsigned int count = jemSnapshotCount(JEM_SNAPSHOT_VIRTUAL);
+    char **names = NULL;
+    struct jem_io_file *files = NULL;
+    int dirfd = -1;
+    unsigned int n;
+    if(!count &&
+       (dirfd = open(JEM_PKG_VIRTUAL_PATH,O_RDONLY|O_DIRECTORY|O_CLOEXEC))>=0 &&
+       (names = jemGetDirNames(dirfd,&count)) &&
+       (files = calloc(count,sizeof(struct jem_io_file)))) {
+        for(n=0;n<count;n++)
+            files[n].name = names[n];
+        jemIoReadFiles(dirfd,files,count);
+    }
+    for(n=0;n<count;n++) {
+        struct jem_param *params = NULL;
+        const char *name;
+        if(names) {
+            name = names[n];
+            params = files ? jemIoParseFile(&files[n]) : jemParseFileAt(dirfd,name);
+        } else {
+            name = jemSnapshotName(JEM_SNAPSHOT_VIRTUAL,n);
+            char *virtual_file = NULL;
+            asprintf(&virtual_file,"%s%s",JEM_PKG_VIRTUAL_PATH,name);
+            if(!virtual_file)
+                continue;
+            params = jemSnapshotParseFile(virtual_file);
+            free(virtual_file);
+        }
+        struct jem_virtual *v = NULL;
+        if(params && (v = jemPkgAddVirtual(name))) {
+            char *providers = jemGetKey(params,JEM_KEY_PROVIDERS);
+            char *vm = jemGetKey(params,JEM_KEY_VM);
+            v->has_file = true;
+            if(providers)
+                v->providers = jemPkgSplitProviders(providers,' ');
+            jemConstraintParse(&v->vm,vm);
+        }
+        jemFreeParams(params);
+    }
+    jemIoFreeFiles(files,count);
+    free(files);
+    free(names);
+    if(dirfd>=0)
+        close(dirfd);
+    if(jem_virtuals)
+        qsort(jem_virtuals,jem_virtuals_count,sizeof(struct jem_virtual),jemPkgCompareVirtuals);
+}
+
+/**
+ * Find a virtual package in the process wide cache, loading it if needed
+ *
+ * @param name string containing the name of the virtual
+ * @return a pointer to a virtual struct, or null if not a virtual
+ */
+static struct jem_virtual *jemPkgFindVirtual(const char *name) {
+    if(jem_virtuals_count<0)
+        jemPkgLoadVirtuals();
+    if(!jem_virtuals)
+        return(NULL);
+    struct jem_virtual key = { .name = (char *)name };
+    return(bsearch(&key,jem_virtuals,jem_virtuals_count,sizeof(struct jem_virtual),jemPkgCompareVirtuals));
+}
+
+/**
+ * Get a virtual package from the process wide cache, virtuals.conf and all
+ * virtuals.d files are parsed once on first use
+ *
+ * @param name string containing the name of the virtual
+ * @return a pointer to a virtual struct, or null if not a virtual. Which must NOT be freed!
+ */
+const struct jem_virtual *jemPkgGetVirtual(const char *name) {
+    return(jemPkgFindVirtual(name));
+}
+
+/**
+ * Resolve the active provider of a virtual, the first installed provider
+ *
+ * @param virtual pointer to a virtual struct, vm_provided must be set
+ */
+static void jemPkgResolveVirtual(struct jem_virtual *virtual) {
+    char **providers = virtual->conf_providers;
+    if(!providers) {
+        if(!virtual->has_file)
+            return;
+        if(virtual->vm_provided) {
+            virtual->active = "";
+            return;
+        }
+        providers = virtual->providers;
+        if(!providers)
+            return;
+    }
+    if(!providers[0]) {
+        virtual->active = "";
+        return;
+    }
+    int i;
+    for(i=0;providers[i] && !virtual->active;i++) {
         char *package_env = NULL;
-        asprintf(&package_env,"%s%s%s",JEM_PKG_PATH,provider,JEM_PKG_ENV);
+        asprintf(&package_env,"%s%s%s",JEM_PKG_PATH,providers[i],JEM_PKG_ENV);
         if(!package_env)
             continue;
-        struct stat st;
-        if(stat(package_env,&st)==0) {
-            asprintf(&package,"%s",provider);
-            free(package_env);
-            break;
-        }
+        if(jemSnapshotFileExists(package_env))
+            virtual->active = providers[i];
         free(package_env);
     }
-    free(provider_str);
-    if(!package) {
-        char *msg = NULL;
-        asprintf(&msg,"No virtual providers for %s, please ensure you have\n"
-                      "one of the following package's installed;\n%s",virtual,providers);
-        jemPrintError(msg);
-        free(msg);
+    if(!virtual->active)
+        virtual->wanted = providers;
+}
+
+/**
+ * Get a virtual package with its providers resolved, each virtual is resolved
+ * once. The active vm is loaded only for a virtual with a VM version.
+ *
+ * @param name string containing the name of the virtual
+ * @return a pointer to a virtual struct, or null if not a virtual. Which must NOT be freed!
+ */
+static const struct jem_virtual *jemPkgGetResolvedVirtual(const char *name) {
+    struct jem_virtual *v = jemPkgFindVirtual(name);
+    if(!v)
+        return(v);
+    pthread_mutex_lock(&jem_virtuals_vm_lock);   // vms load on first use
+    if(!v->resolved) {
+        if(v->vm.op && !jem_virtuals_vm_loaded) {
+            struct jem_vm *vm = jemGetActiveVM(&jem_env);
+            jem_virtuals_vm_version = vm ? vm->version : 0;
+            jem_virtuals_vm_loaded = true;
+        }
+        v->vm_provided = v->vm.op &&
+                         jem_virtuals_vm_version &&
+                         jemConstraintMatches(&v->vm,jem_virtuals_vm_version);
+        jemPkgResolveVirtual(v);
+        v->resolved = true;
     }
-    free(providers);
-    return(package);
+    pthread_mutex_unlock(&jem_virtuals_vm_lock);
+    return(v);
+}
+
+/**
+ * Get active package for virtual
+ *
+ * @param virtual string containing the name of the virtual
+ * @return a string containing the value. The string must be freed!
+ */
+char *jemPkgGetActiveVirtualProvider(const char *virtual) {
+    const struct jem_virtual *v = jemPkgGetResolvedVirtual(virtual);
+    if(!v)
+        return(NULL);
+    if(v->active)
+        return(strdup(v->active));
+    if(v->wanted) {
+        struct jem_str msg = { NULL, 0, 0 };
+        jemStrAppendf(&msg,"No virtual providers for %s, please ensure you have\n"
+                           "one of the following package's installed;\n",virtual);
+        int i;
+        for(i=0;v->wanted[i];i++) {
+            if(i)
+                jemStrAppend(&msg,",");
+            jemStrAppend(&msg,v->wanted[i]);
+        }
+        if(msg.str)
+            jemPrintError(msg.str);
+        jemStrFree(&msg);
+    }
+    return(NULL);
 }
 
 /**
@@ -417,87 +669,108 @@ char *jemPkgGetActiveVirtualProvider(const char *virtual) {
  * @return a string containing the value. The string must be freed!
  */
 char *jemPkgGetVirtualProviders(const char *virtual,bool ignore_vm) {
-    char *packages = NULL;
+    struct jem_str packages = { NULL, 0, 0 };
     char *virtual_name = NULL;
     char *virtual_str = calloc(strlen(virtual)+1,sizeof(char));
     char *v_cursor = virtual_str;
     memcpy(v_cursor,virtual,strlen(virtual));
     while((virtual_name = strsep(&v_cursor,","))) {
-        char *virtual_file = NULL;
-        asprintf(&virtual_file,"%s%s",JEM_PKG_VIRTUAL_PATH,virtual_name);
-        struct stat st;
-        if(virtual_file) {
-            struct jem_param *params = NULL;
-            if(stat(virtual_file,&st)==0) // no output if file exist, remove for error if it does not
-                params = jemParseFile(virtual_file);
-            if(params) {
-                char *providers = jemGetValue(params,"PROVIDERS");
-                char *vvm_version = jemGetValue(params,"VM");
-                if(vvm_version && !ignore_vm) {
-                    while (*vvm_version && !isdigit(*vvm_version)) // skip through non-digit/alpha characters
-                        vvm_version++;
-                    initEnvVMs();
-                    struct jem_vm *vm = jemGetActiveVM(&jem_env);
-                    float vm_version = atof(jemVmGetProvidesVersion(vm->params));
-                    if(atof(vvm_version)<=vm_version)
-                        providers = "";
-                }
-                if(providers) {
-                    char *provide = NULL;
-                    char *pkgs_str = calloc(strlen(providers)+1,sizeof(char));
-                    char *p_cursor = pkgs_str;
-                    memcpy(p_cursor,providers,strlen(providers));
-                    while((provide = strsep(&p_cursor," "))) {
-                        if(packages) {
-                            char *old_packages = packages;
-                            asprintf(&packages,"%s,%s",packages,provide);
-                            free(old_packages);
-                        } else
-                            asprintf(&packages,"%s",provide);
-                    }
-                    free(pkgs_str);
-                }
-                jemFreeParams(params);
-            }
-            free(virtual_file);
-        }
+        const struct jem_virtual *v = jemPkgGetResolvedVirtual(virtual_name);
+        if(!v || !v->has_file)
+            continue;
+        char *empty[] = { "", NULL };
+        char **providers = v->providers;
+        if(!ignore_vm && v->vm_provided)
+            providers = empty;
+        else if(providers && !providers[0])
+            providers = empty;
+        int i;
+        for(i=0;providers && providers[i];i++)
+            jemStrAppendSep(&packages,",",providers[i]);
     }
     free(virtual_str);
-    return(packages);
+    return(jemStrDetach(&packages));
 }
 
 /**
- * Loads a installed env file into a dynamically allocated pkg struct
+ * Loads a installed env file, relative to an open directory, into a
+ * dynamically allocated pkg struct. A file missing from the index snapshot is
+ * opened once, a file that cannot be opened is not installed. The stamp of the
+ * file is taken as it is read, for caches derived from it.
  *
- * @return a pkg struct. Which must be freed, including struct members!
+ * @param dirfd an open directory file descriptor, or AT_FDCWD
+ * @param file the name of the file, relative to dirfd
+ * @param filename the absolute name of the file
+ * @param name the name of the package
+ * @param prefetched pointer to the file if read ahead, or null
+ * @return a pkg struct, or null if not installed. Which must be freed, including struct members!
  */
-struct jem_pkg *jemPkgLoadFile(char *filename, char *name) {
-    struct jem_pkg *pkg = NULL;
-    struct stat st;
-    if(stat(filename,&st)==0) {
-        struct jem_pkg *npkg = calloc(1,sizeof(struct jem_pkg));
-        if(npkg) {
-            pkg = npkg;
-            asprintf(&(pkg->filename),"%s",filename);
-            if(pkg->filename)
-                pkg->params = jemParseFile(pkg->filename);
+static struct jem_pkg *jemPkgLoadFileAt(int dirfd,
+                                        const char *file,
+                                        char *filename,
+                                        char *name,
+                                        const struct jem_io_file *prefetched) {
+    struct jem_param *params = NULL;
+    struct jem_snapshot_stamp stamp;
+    memset(&stamp,0,sizeof(stamp));
+    if(jemSnapshotGetParams(filename,&params))
+        jemSnapshotGetStamp(filename,&stamp);
+    else {
+        if(prefetched && !strcmp(prefetched->name,file)) {
+            if(prefetched->error && prefetched->error!=EACCES && !prefetched->st.st_mode)
+                return(NULL);
+            jemSnapshotStamp(&stamp,&prefetched->st);
+            params = jemIoParseFile(prefetched);
+        } else {
+            int fd = openat(dirfd,file,O_RDONLY|O_CLOEXEC);
+            if(fd>=0) {
+                struct stat st;
+                if(fstat(fd,&st)==0)
+                    jemSnapshotStamp(&stamp,&st);
+                params = jemParseFd(fd);
+                close(fd);
+            } else if(errno==EACCES)
+                jemPrintError("File not readable"); // needs to be changed to throw an exception
             else
-                jemPrintError("Unable to allocate memory to hold package file name");
-            asprintf(&(pkg->name),"%s",name);
-            if(!pkg->name)
-                jemPrintError("Unable to allocate memory to hold package name");
-        } else
-            jemPrintError("Unable to allocate memory to hold package");
+                return(NULL);
+        }
+    }
+    struct jem_pkg *pkg = calloc(1,sizeof(struct jem_pkg));
+    if(pkg) {
+        pkg->params = params;
+        pkg->stamp = stamp;
+        asprintf(&(pkg->filename),"%s",filename);
+        if(!pkg->filename)
+            jemPrintError("Unable to allocate memory to hold package file name");
+        asprintf(&(pkg->name),"%s",name);
+        if(!pkg->name)
+            jemPrintError("Unable to allocate memory to hold package name");
+    } else {
+        jemPrintError("Unable to allocate memory to hold package");
+        jemFreeParams(params);
     }
     return(pkg);
 }
 
 /**
- * Loads a installed package env into a dynamically allocated pkg struct
+ * Loads a installed env file into a dynamically allocated pkg struct
  *
  * @return a pkg struct. Which must be freed, including struct members!
  */
-struct jem_pkg *jemPkgLoadPackage(char *name) {
+struct jem_pkg *jemPkgLoadFile(char *filename, char *name) {
+    return(jemPkgLoadFileAt(AT_FDCWD,filename,filename,name,NULL));
+}
+
+/**
+ * Loads a installed package env into a dynamically allocated pkg struct,
+ * opening its package.env relative to an open JEM_PKG_PATH directory
+ *
+ * @param dirfd an open JEM_PKG_PATH directory file descriptor, or AT_FDCWD
+ * @param name the name of the package
+ * @param prefetched pointer to its package.env if read ahead, or null
+ * @return a pkg struct. Which must be freed, including struct members!
+ */
+static struct jem_pkg *jemPkgLoadPackageAt(int dirfd,char *name,const struct jem_io_file *prefetched) {
     struct jem_pkg *pkg = NULL;
     char *package_env = NULL;
     char *virt_pkg = jemPkgGetActiveVirtualProvider(name);
@@ -510,57 +783,459 @@ struct jem_pkg *jemPkgLoadPackage(char *name) {
     } else
         asprintf(&package_env,"%s%s%s",JEM_PKG_PATH,name,JEM_PKG_ENV);
     if(package_env) {
-        pkg = jemPkgLoadFile(package_env,name);
+        char *file = package_env;
+        if(dirfd!=AT_FDCWD &&
+           !strncmp(package_env,JEM_PKG_PATH,strlen(JEM_PKG_PATH)))
+            file += strlen(JEM_PKG_PATH);
+        else
+            dirfd = AT_FDCWD;
+        pkg = jemPkgLoadFileAt(dirfd,file,package_env,name,prefetched);
         free(package_env);
     }
     return(pkg);
 }
 
 /**
- * Loads all installed package env into a dynamically allocated pkg struct array
+ * Loads a installed package env into a dynamically allocated pkg struct
  *
- * @param virtual boolean to control loading of virtual or package.env file
- * @return an array of pkg structs. Which must be freed, including struct members!
+ * @return a pkg struct. Which must be freed, including struct members!
  */
-struct jem_pkg *jemPkgLoadPackages(bool virtual) {
-    DIR *dp;
-    struct jem_pkg *pkgs = NULL;
-    int i = 0;
-    char *path = virtual ? JEM_PKG_VIRTUAL_PATH : JEM_PKG_PATH;
-    if((dp = opendir(path))) {
-        struct dirent *file;
-        while((file = readdir(dp))) {
-            if(!strcmp(file->d_name,".") ||
-               !strcmp(file->d_name,".."))
-                continue;
-            struct jem_pkg *pkg;
-            if(virtual)
-                pkg = jemPkgLoadVirtual(file->d_name);
-            else
-                pkg = jemPkgLoadPackage(file->d_name);
-            if(pkg) {
-                struct jem_pkg *npkgs = realloc(pkgs,sizeof(struct jem_pkg)*(i+2));
-                if(npkgs) {
-                    pkgs = npkgs;
-                    pkgs[i+1].filename = NULL;
-                    pkgs[i+1].name = NULL;
-                    pkgs[i+1].params = NULL;
-                    pkgs[i] = *pkg;
-                    free(pkg);
-                    i++;
-                } else
-                    jemPrintError("Unable to allocate memory to hold all package.env files"); // needs to clean up and exit under error, not just print a message
-            }
-        }
-        closedir(dp);
-    } else {
+struct jem_pkg *jemPkgLoadPackage(char *name) {
+    return(jemPkgLoadPackageAt(AT_FDCWD,name,NULL));
+}
+
+/**
+ * Loads a installed virtual into a dynamically allocated pkg struct, opening
+ * it relative to an open JEM_PKG_VIRTUAL_PATH directory
+ *
+ * @param dirfd an open JEM_PKG_VIRTUAL_PATH directory file descriptor, or AT_FDCWD
+ * @param name the name of the virtual
+ * @param prefetched pointer to its file if read ahead, or null
+ * @return a pkg struct. Which must be freed, including struct members!
+ */
+static struct jem_pkg *jemPkgLoadVirtualAt(int dirfd,char *name,const struct jem_io_file *prefetched) {
+    struct jem_pkg *pkg = NULL;
+    char *virtual = NULL;
+    asprintf(&virtual,"%s%s",JEM_PKG_VIRTUAL_PATH,name);
+    if(virtual) {
+        pkg = jemPkgLoadFileAt(dirfd,dirfd==AT_FDCWD ? virtual : name,virtual,name,prefetched);
+        free(virtual);
+    }
+    return(pkg);
+}
+
+/**
+ * Open a directory and get the names of all its entries, except . and ..
+ *
+ * @param path the directory name
+ * @param count set to the amount of names
+ * @param dirfd set to the open directory file descriptor, which must be closed
+ * @return an array of strings, the array and strings are a single allocation,
+ *         or null on error. The array must be freed, strings must NOT be freed!
+ */
+static char **jemPkgGetDirNames(const char *path,unsigned int *count,int *dirfd) {
+    *count = 0;
+    if((*dirfd = open(path,O_RDONLY|O_DIRECTORY|O_CLOEXEC))<0) {
         if(errno==EACCES)
             jemPrintError("Package directory not readable"); // needs to be changed to throw an exception
         else
             jemPrintError("Invalid package directory"); // needs to be changed to throw an exception
+        return(NULL);
+    }
+    return(jemGetDirNames(*dirfd,count));
+}
+
+/**
+ * Get the length of the base name of a package, its name without a trailing
+ * -slot made of digits and dots
+ *
+ * @param name string name of the package
+ * @return the length of the base name
+ */
+static size_t jemPkgBaseLen(const char *name) {
+    const char *dash = strrchr(name,'-');
+    if(!dash || dash==name ||
+       !strspn(dash+1,"0123456789") ||
+       dash[1+strspn(dash+1,"0123456789.")])
+        return(strlen(name));
+    return(dash-name);
+}
+
+/**
+ * Get the slot of a package, 0 for the default slot
+ *
+ * @param name string name of the package
+ * @return a string containing the value. The string must NOT be freed!
+ */
+static const char *jemPkgGetSlot(const char *name) {
+    size_t len = jemPkgBaseLen(name);
+    return(name[len] ? name+len+1 : "0");
+}
+
+/**
+ * Compares the slots of two packages, highest first, used soley by qsort in
+ * jemPkgLoadSlots()
+ *
+ * @return an integer -1, 0, or 1.
+ */
+static int jemPkgCmpSlots(const void *v1, const void *v2) {
+    return(strverscmp(jemPkgGetSlot(*(char * const *)v2),jemPkgGetSlot(*(char * const *)v1)));
+}
+
+/**
+ * Find the slot index entry of a base name
+ *
+ * @param base string base name of the package
+ * @return a pointer to the entry holding the base name, or the empty entry
+ */
+static struct jem_pkg_slots *jemPkgFindBase(const char *base) {
+    size_t i = jemPkgHashName(base) & (jem_pkg_slots_size-1);
+    while(jem_pkg_bases[i].base && strcmp(jem_pkg_bases[i].base,base))
+        i = (i+1) & (jem_pkg_slots_size-1);
+    return(&jem_pkg_bases[i]);
+}
+
+/**
+ * Find a package name in the slot index
+ *
+ * @param name string name of the package
+ * @return a pointer to the hash slot holding the name, or the empty hash slot
+ */
+static char **jemPkgFindName(const char *name) {
+    size_t i = jemPkgHashName(name) & (jem_pkg_slots_size-1);
+    while(jem_pkg_names[i] && strcmp(jem_pkg_names[i],name))
+        i = (i+1) & (jem_pkg_slots_size-1);
+    return(&jem_pkg_names[i]);
+}
+
+/**
+ * Build the slot index once, from the package names in the index snapshot, or
+ * without one from a single listing of the package directory. Must be called
+ * holding jem_pkg_slots_lock.
+ */
+static void jemPkgLoadSlots(void) {
+    if(jem_pkg_slots_size)
+        return;
+    int dirfd = AT_FDCWD;
+    char **names;
+    unsigned int count = jemSnapshotCount(JEM_SNAPSHOT_PKG);
+    unsigned int i;
+    if(count) {
+        names = calloc(count,sizeof(char *));
+        for(i=0;names && i<count;i++)
+            names[i] = (char *)jemSnapshotName(JEM_SNAPSHOT_PKG,i);
+    } else if(!(names = jemPkgGetDirNames(JEM_PKG_PATH,&count,&dirfd))) {
+        if(dirfd>=0)
+            close(dirfd);
+        return;
+    }
+    if(dirfd>=0)
+        close(dirfd);
+    size_t size = 64;
+    while(size<(size_t)count*2)
+        size *= 2;
+    jem_pkg_bases = calloc(size,sizeof(struct jem_pkg_slots));
+    jem_pkg_names = calloc(size,sizeof(char *));
+    if(!names || !jem_pkg_bases || !jem_pkg_names) {
+        jemPrintError("Unable to allocate memory to hold package slots"); // needs to clean up and exit under error, not just print a message
+        free(jem_pkg_bases);
+        free(jem_pkg_names);
+        jem_pkg_bases = NULL;
+        jem_pkg_names = NULL;
+        free(names);
+        return;
+    }
+    jem_pkg_slots_size = size;
+    for(i=0;i<count;i++) {
+        char **name = jemPkgFindName(names[i]);
+        if(*name || !(*name = strdup(names[i])))
+            continue;
+        char *base = strndup(*name,jemPkgBaseLen(*name));
+        struct jem_pkg_slots *slots = base ? jemPkgFindBase(base) : NULL;
+        char **tmp = slots ? realloc(slots->names,sizeof(char *)*(slots->count+1)) : NULL;
+        if(!tmp) {
+            jemPrintError("Unable to allocate memory to hold package slots"); // needs to clean up and exit under error, not just print a message
+            free(base);
+            continue;
+        }
+        slots->names = tmp;
+        slots->names[slots->count++] = *name;
+        if(slots->base)
+            free(base);
+        else
+            slots->base = base;
+    }
+    free(names);
+    size_t s;
+    for(s=0;s<size;s++)
+        if(jem_pkg_bases[s].count>1)
+            qsort(jem_pkg_bases[s].names,jem_pkg_bases[s].count,sizeof(char *),jemPkgCmpSlots);
+}
+
+/**
+ * Resolve a package name to an installed package, using the slot index. A
+ * base name resolves to its highest installed slot, base:slot and base-slot
+ * to the package of that slot, the default slot 0 has no suffix.
+ *
+ * @param name string name of the package, as base, base:slot or base-slot
+ * @return a string containing the package name, or null if not installed.
+ *         The string must NOT be freed, it remains valid until jemFreePkgSlots()!
+ */
+const char *jemPkgResolveName(const char *name) {
+    const char *resolved = NULL;
+    pthread_mutex_lock(&jem_pkg_slots_lock);
+    jemPkgLoadSlots();
+    const char *slot = strchr(name,':');
+    if(jem_pkg_slots_size && slot) {
+        char pkg_name[PATH_MAX];
+        int len = slot-name;
+        if(strcmp(slot+1,"0")==0)   // the default slot has no suffix
+            snprintf(pkg_name,sizeof(pkg_name),"%.*s",len,name);
+        else
+            snprintf(pkg_name,sizeof(pkg_name),"%.*s-%s",len,name,slot+1);
+        resolved = *jemPkgFindName(pkg_name);
+    } else if(jem_pkg_slots_size && jemPkgBaseLen(name)<strlen(name))
+        resolved = *jemPkgFindName(name);
+    else if(jem_pkg_slots_size) {
+        struct jem_pkg_slots *slots = jemPkgFindBase(name);
+        if(slots->base)
+            resolved = slots->names[0];
+    }
+    pthread_mutex_unlock(&jem_pkg_slots_lock);
+    return(resolved);
+}
+
+/**
+ * Get the installed packages of a base name
+ *
+ * @param base string base name of the package
+ * @param count pointer to store the amount of packages
+ * @return an array of package names, highest slot first, or null if none.
+ *         The array and strings must NOT be freed, they remain valid until
+ *         jemFreePkgSlots()!
+ */
+char **jemPkgGetSlots(const char *base,unsigned int *count) {
+    char **names = NULL;
+    *count = 0;
+    pthread_mutex_lock(&jem_pkg_slots_lock);
+    jemPkgLoadSlots();
+    if(jem_pkg_slots_size) {
+        struct jem_pkg_slots *slots = jemPkgFindBase(base);
+        if(slots->base) {
+            names = slots->names;
+            *count = slots->count;
+        }
+    }
+    pthread_mutex_unlock(&jem_pkg_slots_lock);
+    return(names);
+}
+
+/**
+ * Get the files to read ahead for packages or virtuals, name/package.env
+ * relative to JEM_PKG_PATH, or name relative to JEM_PKG_VIRTUAL_PATH
+ *
+ * @param names array of package or virtual names
+ * @param count the amount of names
+ * @param virtual boolean for virtual instead of package.env files
+ * @return an array of files, the array and file names are a single allocation,
+ *         or null on error. The array must be freed, file names must NOT be freed!
+ */
+static struct jem_io_file *jemPkgPrefetchFiles(char **names,unsigned int count,bool virtual) {
+    const char *suffix = virtual ? "" : JEM_PKG_ENV+1;
+    size_t size = sizeof(struct jem_io_file)*count;
+    unsigned int i;
+    for(i=0;i<count;i++)
+        size += strlen(names[i])+strlen(suffix)+2;
+    struct jem_io_file *files = calloc(1,size);
+    if(!files) {
+        jemPrintError("Unable to allocate memory to hold package files"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    char *str = (char *)(files+count);
+    for(i=0;i<count;i++) {
+        files[i].name = str;
+        if(virtual)
+            str += sprintf(str,"%s",names[i])+1;
+        else
+            str += sprintf(str,"%s/%s",names[i],suffix)+1;
     }
+    return(files);
+}
+
+/**
+ * Start reading the package.env files of packages ahead of loading them. Only
+ * used when reads are batched through io_uring, and the index snapshot is not.
+ *
+ * @param names array of package names
+ * @param count the amount of names
+ * @return a prefetch, or null if not in use. Which must be freed using jemPkgFreePrefetch()!
+ */
+struct jem_pkg_prefetch *jemPkgPrefetch(char **names,unsigned int count) {
+    if(!count || !jemIoAvailable() || jemSnapshotCount(JEM_SNAPSHOT_PKG))
+        return(NULL);
+    struct jem_pkg_prefetch *prefetch = calloc(1,sizeof(struct jem_pkg_prefetch));
+    if(!prefetch)
+        return(NULL);
+    prefetch->count = count;
+    if((prefetch->dirfd = open(JEM_PKG_PATH,O_RDONLY|O_DIRECTORY|O_CLOEXEC))<0 ||
+       !(prefetch->files = jemPkgPrefetchFiles(names,count,false))) {
+        jemPkgFreePrefetch(prefetch);
+        return(NULL);
+    }
+    prefetch->batch = jemIoSubmit(prefetch->dirfd,prefetch->files,count);
+    return(prefetch);
+}
+
+/**
+ * Loads a installed package env, using its read ahead package.env file
+ *
+ * @param prefetch pointer to a prefetch returned by jemPkgPrefetch()
+ * @param i the index of the package in the names given to jemPkgPrefetch()
+ * @param name the name of the package
+ * @return a pkg struct. Which must be freed, including struct members!
+ */
+struct jem_pkg *jemPkgLoadPrefetched(struct jem_pkg_prefetch *prefetch,unsigned int i,char *name) {
+    if(!prefetch || i>=prefetch->count)
+        return(jemPkgLoadPackage(name));
+    jemIoWaitFile(prefetch->batch,i);
+    return(jemPkgLoadPackageAt(prefetch->dirfd,name,&prefetch->files[i]));
+}
+
+/**
+ * Frees a prefetch, waiting for any pending reads
+ *
+ * @param prefetch pointer to a prefetch returned by jemPkgPrefetch(), may be null
+ */
+void jemPkgFreePrefetch(struct jem_pkg_prefetch *prefetch) {
+    if(!prefetch)
+        return;
+    jemIoWait(prefetch->batch);
+    jemIoFreeFiles(prefetch->files,prefetch->count);
+    free(prefetch->files);
+    if(prefetch->dirfd>=0)
+        close(prefetch->dirfd);
+    free(prefetch);
+}
+
+/**
+ * Load packages until none are left, run by each package loading thread
+ *
+ * @param arg pointer to the shared jem_pkg_loader struct
+ * @return null
+ */
+static void *jemPkgLoadWorker(void *arg) {
+    struct jem_pkg_loader *loader = arg;
+    for(;;) {
+        pthread_mutex_lock(&loader->lock);
+        unsigned int i = loader->next++;
+        pthread_mutex_unlock(&loader->lock);
+        if(i>=loader->count)
+            break;
+        struct jem_io_file *file = loader->files ? &loader->files[i] : NULL;
+        if(loader->virtual)
+            loader->pkgs[i] = jemPkgLoadVirtualAt(loader->dirfd,loader->names[i],file);
+        else
+            loader->pkgs[i] = jemPkgLoadPackageAt(loader->dirfd,loader->names[i],file);
+    }
+    return(NULL);
+}
+
+/**
+ * Get the amount of package loading threads, jem_jobs, or JEM_JOBS from the
+ * environment, or the amount of online processors, bounded by the amount of
+ * files and JEM_PKG_JOBS_MAX
+ *
+ * @param count the amount of files to load
+ * @return the amount of threads, at least 1
+ */
+static unsigned int jemPkgGetJobs(unsigned int count) {
+    unsigned long jobs = jem_jobs;
+    char *env;
+    if(!jobs && (env = getenv("JEM_JOBS")))
+        jobs = strtoul(env,NULL,10);
+    if(!jobs) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus>0 ? cpus : 1;
+    }
+    if(jobs>JEM_PKG_JOBS_MAX)
+        jobs = JEM_PKG_JOBS_MAX;
+    if(jobs>count)
+        jobs = count;
+    return(jobs ? jobs : 1);
+}
+
+/**
+ * Loads all installed package env into a dynamically allocated pkg struct array.
+ * Files are parsed by a pool of threads, unless the index snapshot is in use.
+ *
+ * @param virtual boolean to control loading of virtual or package.env file
+ * @return an array of pkg structs. Which must be freed, including struct members!
+ */
+struct jem_pkg *jemPkgLoadPackages(bool virtual) {
+    struct jem_pkg_loader loader;
+    memset(&loader,0,sizeof(loader));
+    loader.virtual = virtual;
+    loader.dirfd = AT_FDCWD;
+    enum jem_snapshot_kind kind = virtual ? JEM_SNAPSHOT_VIRTUAL : JEM_SNAPSHOT_PKG;
+    unsigned int jobs = 1;
+    if((loader.count = jemSnapshotCount(kind))) {
+        loader.names = calloc(loader.count+1,sizeof(char *));
+        unsigned int i;
+        for(i=0;loader.names && i<loader.count;i++)
+            loader.names[i] = (char *)jemSnapshotName(kind,i);
+    } else {
+        loader.names = jemPkgGetDirNames(virtual ? JEM_PKG_VIRTUAL_PATH : JEM_PKG_PATH,&loader.count,&loader.dirfd);
+        jobs = jemPkgGetJobs(loader.count);
+        if(loader.names && jemIoAvailable() &&
+           (loader.files = jemPkgPrefetchFiles(loader.names,loader.count,virtual)))
+            jemIoReadFiles(loader.dirfd,loader.files,loader.count);    // threads only parse
+    }
+    loader.pkgs = calloc(loader.count+1,sizeof(struct jem_pkg *));
+    if(!loader.names || !loader.pkgs) {
+        jemIoFreeFiles(loader.files,loader.count);
+        free(loader.files);
+        free(loader.names);
+        free(loader.pkgs);
+        if(loader.dirfd>=0)
+            close(loader.dirfd);
+        return(NULL);
+    }
+    if(jem_virtuals_count<0)    // load before threads share it
+        jemPkgLoadVirtuals();
+    pthread_mutex_init(&loader.lock,NULL);
+    pthread_t *threads = calloc(jobs,sizeof(pthread_t));
+    unsigned int started = 0;
+    while(threads && started+1<jobs &&
+          pthread_create(&threads[started],NULL,jemPkgLoadWorker,&loader)==0)
+        started++;
+    jemPkgLoadWorker(&loader);
+    unsigned int t;
+    for(t=0;t<started;t++)
+        pthread_join(threads[t],NULL);
+    free(threads);
+    pthread_mutex_destroy(&loader.lock);
+    jemIoFreeFiles(loader.files,loader.count);
+    free(loader.files);
+    if(loader.dirfd>=0)
+        close(loader.dirfd);
+    struct jem_pkg *pkgs = NULL;
+    unsigned int i;
+    int n = 0;
+    for(i=0;i<loader.count;i++) {
+        struct jem_pkg *pkg = loader.pkgs[i];
+        if(!pkg)
+            continue;
+        if(!pkgs && !(pkgs = calloc(loader.count+1-i,sizeof(struct jem_pkg)))) {
+            jemPrintError("Unable to allocate memory to hold all package.env files"); // needs to clean up and exit under error, not just print a message
+            jemFreePkg(pkg);
+        } else
+            pkgs[n++] = *pkg;
+        free(pkg);
+    }
+    free(loader.pkgs);
+    free(loader.names);
     if(pkgs)
-        qsort(pkgs,i+2,sizeof(struct jem_pkg),jemPkgLoadPackagesCompare);
+        qsort(pkgs,n,sizeof(struct jem_pkg),jemPkgLoadPackagesCompare);
     return(pkgs);
 }
 
@@ -583,12 +1258,5 @@ int jemPkgLoadPackagesCompare(const void *v1, const void *v2) {
  * @return a pkg struct. Which must be freed, including struct members!
  */
 struct jem_pkg *jemPkgLoadVirtual(char *name) {
-    struct jem_pkg *pkg = NULL;
-    char *virtual = NULL;
-    asprintf(&virtual,"%s%s",JEM_PKG_VIRTUAL_PATH,name);
-    if(virtual) {
-        pkg = jemPkgLoadFile(virtual,name);
-        free(virtual);
-    }
-    return(pkg);
+    return(jemPkgLoadVirtualAt(AT_FDCWD,name,NULL));
 }
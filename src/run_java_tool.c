@@ -0,0 +1,96 @@
+/***************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *  
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Java tool launcher, symlinked as java, javac, jar, etc. Executes the tool
+ * of the active VM, selected by JEM_VM, the user VM, or the system VM.
+ */
+
+#include <libgen.h>
+#include <stdio.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "../include/env_manager.h"
+
+#define JEM_RUN_JAVA_TOOL "run-java-tool"
+#define JEM_ITWEB_JAVAWS "/usr/bin/itweb-javaws"
+
+struct jem_env jem_env;
+
+/**
+ * Print why the active VM could not be found, by where it was selected
+ */
+static void jemPrintInvalidVM(void) {
+    char *msg = NULL;
+    char *vm_name = getenv("JEM_VM");
+    char *user_vm = NULL;
+    if(vm_name)
+        asprintf(&msg,"Invalid value for JEM_VM: %s",vm_name);
+    else if((user_vm = jemVmGetUserVMLink()) && access(user_vm,F_OK)==0)
+        asprintf(&msg,"Invalid User VM: %s",user_vm);
+    else
+        asprintf(&msg,"Invalid System VM: %s",jemVmGetSystemVMLink());
+    if(msg)
+        jemPrintError(msg);
+    free(msg);
+    free(user_vm);
+}
+
+int main(int argc, char **argv) {
+    char *tool = basename(argv[0]);
+    if(strcmp(tool,"javaws")==0 && access(JEM_ITWEB_JAVAWS,X_OK)==0) {
+        argv[0] = JEM_ITWEB_JAVAWS;
+        execve(JEM_ITWEB_JAVAWS,argv,environ);
+    }
+    if(strcmp(tool,JEM_RUN_JAVA_TOOL)==0) {
+        jemPrintError(JEM_RUN_JAVA_TOOL " should only be used via symlinks to it");
+        return(EXIT_FAILURE);
+    }
+
+    jemInitEnv(&jem_env);
+    struct jem_vm *vm = jemLoadActiveVM(&jem_env);
+    if(!vm)
+        jemPrintInvalidVM();
+    else {
+        char *exec = jemVmGetTool(vm,tool);
+        if(exec) {
+            argv[0] = exec;
+            execve(exec,argv,environ);
+            jemPrintError("Unable to execute command");
+            free(exec);
+        } else {
+            struct utsname uts;
+            char *msg = NULL;
+            asprintf(&msg,"%s is not available for %s on %s",
+                     tool,
+                     jemVmGetName(vm),
+                     uname(&uts)==0 ? uts.machine : "this machine");
+            if(msg)
+                jemPrintError(msg);
+            free(msg);
+        }
+    }
+    jemCleanup();
+    return(EXIT_FAILURE);
+}
@@ -0,0 +1,884 @@
+/****************************************************************************
+ *  Copyright 2015-2018 Obsidian-Studios, Inc.
+ *  Author William L. Thomson Jr.
+ *         wlt@o-sinc.com
+ ****************************************************************************/
+
+/*
+ *  This file is part of jem.
+ *
+ *  jem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  jem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/dir.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/package.h"
+#include "../include/snapshot.h"
+#include "../include/vm.h"
+
+#define JEM_SNAPSHOT_MAGIC "JEMSNAP"
+#define JEM_SNAPSHOT_VERSION 3
+#define JEM_SNAPSHOT_ALIGN(x) (((x)+7) & ~(uint64_t)7)
+
+bool jem_use_cache = true;
+
+/**
+ * Fixed size snapshot record of a parsed file
+ */
+struct jem_snapshot_record {
+    uint32_t name;          /** string table offset of the package/virtual/vm name */
+    uint32_t filename;      /** string table offset of the absolute file name */
+    uint64_t params;        /** file offset of the packed params, 0 if none */
+    uint64_t params_size;   /** size of the packed params */
+    struct jem_snapshot_stamp stamp;    /** stamp of the file */
+};
+
+/**
+ * Snapshot file header, followed by the records, hash buckets, string table
+ * and packed params
+ */
+struct jem_snapshot_header {
+    char magic[8];                  /** JEM_SNAPSHOT_MAGIC */
+    uint32_t version;               /** JEM_SNAPSHOT_VERSION */
+    uint32_t param_size;            /** sizeof(struct jem_param) of the writer */
+    uint64_t size;                  /** size of the snapshot file */
+    struct jem_snapshot_stamp roots[JEM_SNAPSHOT_KINDS];   /** stamps of the scanned directories */
+    uint32_t first[JEM_SNAPSHOT_KINDS];    /** index of the first record of each kind */
+    uint32_t count[JEM_SNAPSHOT_KINDS];    /** amount of records of each kind */
+    uint32_t records;               /** amount of records */
+    uint32_t mask;                  /** hash bucket mask, the bucket count is a power of 2 */
+    uint64_t record_off;            /** file offset of the records */
+    uint64_t bucket_off;            /** file offset of the hash buckets, record index + 1 or 0 */
+    uint64_t string_off;            /** file offset of the string table */
+};
+
+/**
+ * A memory mapped snapshot
+ */
+struct jem_snapshot {
+    void *map;                                  /** mapped snapshot file */
+    size_t size;                                /** size of the mapping */
+    const struct jem_snapshot_header *header;
+    const struct jem_snapshot_record *records;
+    const uint32_t *buckets;
+    const char *strings;
+    signed char *checked;                       /** per record, 0 not checked, 1 current, -1 changed */
+};
+
+/**
+ * A file scanned while building a snapshot
+ */
+struct jem_snapshot_entry {
+    char *name;                 /** package/virtual/vm name */
+    char *filename;             /** absolute file name */
+    struct stat st;             /** file stat */
+    struct jem_param *params;   /** parsed file */
+};
+
+static struct jem_snapshot jem_snapshot;
+static int jem_snapshot_state = 0;  /** 0 not loaded, 1 mapped, -1 not available */
+static bool jem_snapshot_stale = false; /** a record's file changed, rebuilt on close */
+
+/**
+ * Scanned directories, or file for JEM_SNAPSHOT_CONFIG, indexed by kind.
+ * JEM_SNAPSHOT_RELEASE and JEM_SNAPSHOT_TOOLS have no root, their files
+ * follow the vm files.
+ */
+static const char *jem_snapshot_roots[] = {
+    JEM_PKG_PATH,
+    JEM_PKG_VIRTUAL_PATH,
+    JEM_VMS_PATH,
+    JEM_PKG_VIRTUAL_CONFIG,
+    NULL,
+    NULL
+};
+
+/**
+ * Fill in a stamp from a file stat
+ *
+ * @param stamp pointer to a stamp struct to fill in
+ * @param st pointer to the stat of the file
+ */
+void jemSnapshotStamp(struct jem_snapshot_stamp *stamp,const struct stat *st) {
+    stamp->mtime = st->st_mtim.tv_sec;
+    stamp->mtime_nsec = st->st_mtim.tv_nsec;
+    stamp->ino = st->st_ino;
+    stamp->size = st->st_size;
+}
+
+/**
+ * Get the stamp of a file or directory, a missing file gets an empty stamp
+ *
+ * @param stamp pointer to a stamp struct to fill in
+ * @param file the absolute file name
+ * @return true if the file exists, false otherwise
+ */
+bool jemSnapshotStampFile(struct jem_snapshot_stamp *stamp,const char *file) {
+    struct stat st;
+    memset(stamp,0,sizeof(*stamp));
+    if(stat(file,&st)!=0)
+        return(false);
+    jemSnapshotStamp(stamp,&st);
+    return(true);
+}
+
+/**
+ * Check a stamp against a file, a missing file matches an empty stamp
+ *
+ * @param stamp pointer to a stamp struct
+ * @param file the absolute file name
+ * @return true if the file has not changed, false otherwise
+ */
+bool jemSnapshotStampMatches(const struct jem_snapshot_stamp *stamp,const char *file) {
+    struct jem_snapshot_stamp cur;
+    jemSnapshotStampFile(&cur,file);
+    return(stamp->mtime==cur.mtime &&
+           stamp->mtime_nsec==cur.mtime_nsec &&
+           stamp->ino==cur.ino &&
+           stamp->size==cur.size);
+}
+
+/**
+ * FNV-1a hash of a file name
+ */
+static uint32_t jemSnapshotHash(const char *str) {
+    uint32_t hash = 2166136261u;
+    for(;*str;str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 16777619u;
+    }
+    return(hash);
+}
+
+/**
+ * Get the cache directories, the system directory first followed by the
+ * user's, or only JEM_CACHE_DIR when set in the environment
+ *
+ * @return a null terminated array of directory names ending in a /. The array
+ *         and strings must be freed!
+ */
+char **jemCacheDirs(void) {
+    char **dirs = calloc(3,sizeof(char *));
+    if(!dirs) {
+        jemPrintError("Unable to allocate memory to hold cache directories");
+        return(NULL);
+    }
+    char *env = getenv("JEM_CACHE_DIR");
+    if(env) {
+        if(strlen(env)>0)   // empty disables the cache
+            asprintf(&dirs[0],"%s/",env);
+        return(dirs);
+    }
+    int i = 0;
+    asprintf(&dirs[i++],"%s",JEM_CACHE_PATH);
+    if((env = getenv("XDG_CACHE_HOME")) && strlen(env)>0)
+        asprintf(&dirs[i],"%s/%s/",env,JEM);
+    else if((env = getenv("HOME")))
+        asprintf(&dirs[i],"%s/%s",env,JEM_CACHE_USER_SUFFIX);
+    return(dirs);
+}
+
+/**
+ * Check that a string table offset lies within the mapping and the string is
+ * null terminated before its end
+ */
+static bool jemSnapshotStringValid(const char *map,uint64_t size,uint64_t off) {
+    return(off<size && memchr(map+off,'\0',size-off));
+}
+
+/**
+ * Check the layout of a mapped snapshot before anything in it is used, so a
+ * truncated or corrupt file is rejected instead of read out of bounds
+ *
+ * @param map the mapped snapshot file
+ * @param size the size of the mapping
+ * @return true if all offsets and indexes lie within the mapping
+ */
+static bool jemSnapshotLayoutValid(const char *map,uint64_t size) {
+    const struct jem_snapshot_header *header = (const struct jem_snapshot_header *)map;
+    uint64_t buckets = (uint64_t)header->mask+1;
+    if(header->size!=size ||
+       header->record_off>size ||
+       header->record_off%8 ||
+       header->records>(size-header->record_off)/sizeof(struct jem_snapshot_record) ||
+       buckets & (buckets-1) ||
+       header->records>=buckets ||
+       header->bucket_off>size ||
+       header->bucket_off%4 ||
+       buckets>(size-header->bucket_off)/sizeof(uint32_t) ||
+       header->string_off>size)
+        return(false);
+    int k;
+    for(k=0;k<JEM_SNAPSHOT_KINDS;k++)
+        if(header->first[k]>header->records ||
+           header->count[k]>header->records-header->first[k])
+            return(false);
+    const uint32_t *bucket = (const uint32_t *)(map+header->bucket_off);
+    uint64_t b;
+    uint64_t used = 0;
+    for(b=0;b<buckets;b++) {
+        if(bucket[b]>header->records)
+            return(false);
+        if(bucket[b])
+            used++;
+    }
+    if(used>header->records)    // a lookup must always reach an empty bucket
+        return(false);
+    const struct jem_snapshot_record *records = (const struct jem_snapshot_record *)(map+header->record_off);
+    uint32_t r;
+    for(r=0;r<header->records;r++) {
+        if(!jemSnapshotStringValid(map,size,header->string_off+(uint64_t)records[r].name) ||
+           !jemSnapshotStringValid(map,size,header->string_off+(uint64_t)records[r].filename))
+            return(false);
+        if(records[r].params &&
+           (records[r].params>size ||
+            records[r].params%8 ||
+            records[r].params_size>size-records[r].params))
+            return(false);
+    }
+    return(true);
+}
+
+/**
+ * Map and validate a snapshot file. Only the stamps of the scanned directories
+ * are checked here, which catch added and removed files, the stamp of a file
+ * is checked when its record is first used.
+ *
+ * @param path the snapshot file name
+ * @return true if the snapshot is valid and now in use, false otherwise
+ */
+static bool jemSnapshotMap(const char *path) {
+    int fd = open(path,O_RDONLY|O_CLOEXEC);
+    if(fd<0)
+        return(false);
+    struct stat st;
+    void *map = MAP_FAILED;
+    if(fstat(fd,&st)==0 &&
+       st.st_size>=(off_t)sizeof(struct jem_snapshot_header))
+        map = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if(map==MAP_FAILED)
+        return(false);
+    const struct jem_snapshot_header *header = map;
+    if(memcmp(header->magic,JEM_SNAPSHOT_MAGIC,sizeof(header->magic))!=0 ||
+       header->version!=JEM_SNAPSHOT_VERSION ||
+       header->param_size!=sizeof(struct jem_param) ||
+       !jemSnapshotLayoutValid(map,st.st_size)) {
+        munmap(map,st.st_size);
+        return(false);
+    }
+    struct jem_snapshot snap = {
+        map,
+        st.st_size,
+        header,
+        (const struct jem_snapshot_record *)((char *)map+header->record_off),
+        (const uint32_t *)((char *)map+header->bucket_off),
+        (const char *)map+header->string_off,
+        NULL
+    };
+    bool valid = true;
+    int i;
+    for(i=0;valid && i<JEM_SNAPSHOT_KINDS;i++)
+        valid = !jem_snapshot_roots[i] ||
+                jemSnapshotStampMatches(&header->roots[i],jem_snapshot_roots[i]);
+    if(valid && !(snap.checked = calloc(header->records+1,sizeof(signed char)))) {
+        jemPrintError("Unable to allocate memory to hold index snapshot");
+        valid = false;
+    }
+    if(!valid) {
+        munmap(map,st.st_size);
+        return(false);
+    }
+    jem_snapshot = snap;
+    return(true);
+}
+
+/**
+ * Compares the names of two snapshot entries, used soley by qsort in jemSnapshotScan()
+ *
+ * @return an integer -1, 0, or 1.
+ */
+static int jemSnapshotCompareEntries(const void *v1,const void *v2) {
+    const struct jem_snapshot_entry *e1 = v1;
+    const struct jem_snapshot_entry *e2 = v2;
+    return(strcmp(e1->name,e2->name));
+}
+
+/**
+ * Scan and parse the files of a kind, adding them to an array of entries
+ *
+ * @param entries array of entries to add to
+ * @param count the amount of entries in the array, updated
+ * @param kind the kind of files to scan
+ * @param root stamp of the scanned directory to fill in
+ * @return the array of entries, or null on error
+ */
+static struct jem_snapshot_entry *jemSnapshotScan(struct jem_snapshot_entry *entries,
+                                                  size_t *count,
+                                                  enum jem_snapshot_kind kind,
+                                                  struct jem_snapshot_stamp *root) {
+    struct stat st;
+    memset(root,0,sizeof(*root));
+    if(kind==JEM_SNAPSHOT_CONFIG) {
+        if(stat(jem_snapshot_roots[kind],&st)!=0)
+            return(entries);
+        jemSnapshotStamp(root,&st);
+        struct jem_snapshot_entry *tmp = NULL;
+        if(!S_ISREG(st.st_mode))
+            return(entries);
+        if(!(tmp = realloc(entries,sizeof(struct jem_snapshot_entry)*(*count+1)))) {
+            jemPrintError("Unable to allocate memory to hold index snapshot entries");
+            return(entries);
+        }
+        entries = tmp;
+        entries[*count].name = strdup(JEM_PKG_VIRTUALS ".conf");
+        entries[*count].filename = strdup(jem_snapshot_roots[kind]);
+        if(entries[*count].name && entries[*count].filename) {
+            entries[*count].st = st;
+            entries[*count].params = jemParseFile(jem_snapshot_roots[kind]);
+            (*count)++;
+        } else {
+            free(entries[*count].name);
+            free(entries[*count].filename);
+        }
+        return(entries);
+    }
+    int dirfd = open(jem_snapshot_roots[kind],O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if(dirfd<0)
+        return(entries);
+    if(fstat(dirfd,&st)==0)
+        jemSnapshotStamp(root,&st);
+    unsigned int names_count;
+    char **names = jemGetDirNames(dirfd,&names_count);
+    struct jem_snapshot_entry *tmp = NULL;
+    if(names_count &&
+       !(tmp = realloc(entries,sizeof(struct jem_snapshot_entry)*(*count+names_count)))) {
+        jemPrintError("Unable to allocate memory to hold index snapshot entries");
+        names_count = 0;
+    } else if(tmp)
+        entries = tmp;
+    size_t root_len = strlen(jem_snapshot_roots[kind]);
+    if(kind==JEM_SNAPSHOT_VM)   // JEM_VMS_PATH has no trailing /
+        root_len++;
+    struct jem_io_file *files = NULL;
+    if(names_count && !(files = calloc(names_count,sizeof(struct jem_io_file)))) {
+        jemPrintError("Unable to allocate memory to hold index snapshot entries");
+        names_count = 0;
+    }
+    size_t first = *count;
+    unsigned int i;
+    for(i=0;i<names_count;i++) {
+        struct jem_snapshot_entry *entry = &entries[first+i];
+        entry->name = strdup(names[i]);
+        entry->filename = NULL;
+        if(kind==JEM_SNAPSHOT_PKG)
+            asprintf(&entry->filename,"%s%s%s",JEM_PKG_PATH,names[i],JEM_PKG_ENV);
+        else if(kind==JEM_SNAPSHOT_VIRTUAL)
+            asprintf(&entry->filename,"%s%s",JEM_PKG_VIRTUAL_PATH,names[i]);
+        else
+            asprintf(&entry->filename,"%s/%s",JEM_VMS_PATH,names[i]);
+        files[i].name = entry->filename ? entry->filename+root_len : "";
+    }
+    jemIoReadFiles(dirfd,files,names_count);
+    for(i=0;i<names_count;i++) {
+        struct jem_snapshot_entry entry = entries[first+i];
+        if(entry.name && entry.filename &&
+           !files[i].error && S_ISREG(files[i].st.st_mode)) {
+            entry.st = files[i].st;
+            entry.params = files[i].buf ? jemParseBuffer(files[i].buf,files[i].size) : NULL;
+            entries[(*count)++] = entry;
+        } else {
+            free(entry.name);
+            free(entry.filename);
+        }
+    }
+    jemIoFreeFiles(files,names_count);
+    free(files);
+    free(names);
+    close(dirfd);
+    qsort(entries+first,*count-first,sizeof(struct jem_snapshot_entry),jemSnapshotCompareEntries);
+    return(entries);
+}
+
+/**
+ * Parse the JAVA_HOME/release files of the scanned vms, adding them to an
+ * array of entries. A missing release file is added with an empty stat and no
+ * params, so the snapshot is rebuilt once it is created.
+ *
+ * @param entries array of entries to add to, holding the scanned vms
+ * @param count the amount of entries in the array, updated
+ * @param first index of the first vm entry
+ * @param vm_count the amount of vm entries
+ * @return the array of entries
+ */
+static struct jem_snapshot_entry *jemSnapshotScanReleases(struct jem_snapshot_entry *entries,
+                                                          size_t *count,
+                                                          size_t first,
+                                                          size_t vm_count) {
+    struct jem_snapshot_entry *tmp = NULL;
+    if(!vm_count)
+        return(entries);
+    if(!(tmp = realloc(entries,sizeof(struct jem_snapshot_entry)*(*count+vm_count)))) {
+        jemPrintError("Unable to allocate memory to hold index snapshot entries");
+        return(entries);
+    }
+    entries = tmp;
+    size_t i;
+    for(i=first;i<first+vm_count;i++) {
+        char *home = jemGetKey(entries[i].params,JEM_KEY_JAVA_HOME);
+        if(!home)
+            continue;
+        struct jem_snapshot_entry entry;
+        memset(&entry,0,sizeof(entry));
+        entry.name = strdup(entries[i].name);
+        asprintf(&entry.filename,"%s/%s",home,JEM_VM_RELEASE);
+        if(!entry.name || !entry.filename) {
+            free(entry.name);
+            free(entry.filename);
+            continue;
+        }
+        if(stat(entry.filename,&entry.st)==0 && S_ISREG(entry.st.st_mode))
+            entry.params = jemParseFile(entry.filename);
+        else
+            memset(&entry.st,0,sizeof(entry.st));
+        entries[(*count)++] = entry;
+    }
+    return(entries);
+}
+
+/**
+ * Read the PATH directories of the scanned vms, adding them to an array of
+ * entries with their entry names as params. A directory shared by vms is added
+ * once, a missing one with an empty stat and no params.
+ *
+ * @param entries array of entries to add to, holding the scanned vms
+ * @param count the amount of entries in the array, updated
+ * @param first index of the first vm entry
+ * @param vm_count the amount of vm entries
+ * @return the array of entries
+ */
+static struct jem_snapshot_entry *jemSnapshotScanTools(struct jem_snapshot_entry *entries,
+                                                       size_t *count,
+                                                       size_t first,
+                                                       size_t vm_count) {
+    size_t tools_first = *count;
+    size_t i;
+    for(i=first;i<first+vm_count;i++) {
+        char *paths = jemVmGetToolPaths(entries[i].params);
+        char *cursor = paths;
+        char *dir;
+        while(cursor && (dir = strsep(&cursor,":"))) {
+            size_t e;
+            for(e=tools_first;*dir && e<*count && strcmp(entries[e].filename,dir);e++);
+            if(!*dir || e<*count)
+                continue;
+            struct jem_snapshot_entry *tmp = realloc(entries,sizeof(struct jem_snapshot_entry)*(*count+1));
+            if(!tmp) {
+                jemPrintError("Unable to allocate memory to hold index snapshot entries");
+                break;
+            }
+            entries = tmp;
+            struct jem_snapshot_entry entry;
+            memset(&entry,0,sizeof(entry));
+            entry.name = strdup(entries[i].name);
+            entry.filename = strdup(dir);
+            if(!entry.name || !entry.filename) {
+                free(entry.name);
+                free(entry.filename);
+                continue;
+            }
+            if(stat(entry.filename,&entry.st)==0 && S_ISDIR(entry.st.st_mode))
+                entry.params = jemVmReadTools(entry.filename);  // after the stat, so a later change is seen
+            else
+                memset(&entry.st,0,sizeof(entry.st));
+            entries[(*count)++] = entry;
+        }
+        free(paths);
+    }
+    return(entries);
+}
+
+/**
+ * Create a directory and any missing parents
+ *
+ * @param dir the directory name ending in a /
+ * @return true if the directory exists, false otherwise
+ */
+bool jemCacheMkdirs(const char *dir) {
+    char *path = strdup(dir);
+    if(!path)
+        return(false);
+    char *slash;
+    for(slash=strchr(path+1,'/');slash;slash=strchr(slash+1,'/')) {
+        *slash = '\0';
+        if(mkdir(path,S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)==-1 &&
+           errno!=EEXIST) {
+            free(path);
+            return(false);
+        }
+        *slash = '/';
+    }
+    free(path);
+    return(true);
+}
+
+/**
+ * Write a snapshot of all scanned files to a file, replacing it atomically
+ *
+ * @param dir the cache directory name ending in a /
+ * @return the snapshot file name, or null on error. The string must be freed!
+ */
+static char *jemSnapshotWrite(const char *dir) {
+    if(!jemCacheMkdirs(dir))
+        return(NULL);
+    struct jem_snapshot_header header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,JEM_SNAPSHOT_MAGIC,sizeof(header.magic));
+    header.version = JEM_SNAPSHOT_VERSION;
+    header.param_size = sizeof(struct jem_param);
+    struct jem_snapshot_entry *entries = NULL;
+    size_t count = 0;
+    int k;
+    for(k=0;k<JEM_SNAPSHOT_KINDS;k++) {
+        header.first[k] = count;
+        if(k==JEM_SNAPSHOT_RELEASE)
+            entries = jemSnapshotScanReleases(entries,
+                                              &count,
+                                              header.first[JEM_SNAPSHOT_VM],
+                                              header.count[JEM_SNAPSHOT_VM]);
+        else if(k==JEM_SNAPSHOT_TOOLS)
+            entries = jemSnapshotScanTools(entries,
+                                           &count,
+                                           header.first[JEM_SNAPSHOT_VM],
+                                           header.count[JEM_SNAPSHOT_VM]);
+        else
+            entries = jemSnapshotScan(entries,&count,k,&header.roots[k]);
+        header.count[k] = count - header.first[k];
+    }
+    header.records = count;
+    size_t buckets = 8;
+    while(buckets<count*2)
+        buckets *= 2;
+    header.mask = buckets-1;
+    header.record_off = sizeof(header);
+    header.bucket_off = header.record_off + sizeof(struct jem_snapshot_record)*count;
+    header.string_off = header.bucket_off + sizeof(uint32_t)*buckets;
+    uint64_t strings = 0;
+    size_t i;
+    for(i=0;i<count;i++)
+        strings += strlen(entries[i].name) + strlen(entries[i].filename) + 2;
+    uint64_t size = JEM_SNAPSHOT_ALIGN(header.string_off + strings);
+    for(i=0;i<count;i++)
+        size += JEM_SNAPSHOT_ALIGN(jemParamsPackedSize(entries[i].params));
+    header.size = size;
+    char *buf = calloc(1,size);
+    char *path = NULL;
+    if(buf) {
+        memcpy(buf,&header,sizeof(header));
+        struct jem_snapshot_record *records = (struct jem_snapshot_record *)(buf+header.record_off);
+        uint32_t *bucket = (uint32_t *)(buf+header.bucket_off);
+        char *str = buf+header.string_off;
+        uint64_t params = JEM_SNAPSHOT_ALIGN(header.string_off + strings);
+        for(i=0;i<count;i++) {
+            records[i].name = str-(buf+header.string_off);
+            str = stpcpy(str,entries[i].name)+1;
+            records[i].filename = str-(buf+header.string_off);
+            str = stpcpy(str,entries[i].filename)+1;
+            jemSnapshotStamp(&records[i].stamp,&entries[i].st);
+            if(entries[i].params) {
+                records[i].params = params;
+                records[i].params_size = jemParamsPackedSize(entries[i].params);
+                jemParamsPack(entries[i].params,buf+params);
+                params += JEM_SNAPSHOT_ALIGN(records[i].params_size);
+            }
+            uint32_t b;
+            for(b=jemSnapshotHash(entries[i].filename) & header.mask;
+                bucket[b];
+                b=(b+1) & header.mask);
+            bucket[b] = i+1;
+        }
+        char *tmp = NULL;
+        asprintf(&tmp,"%s%s.XXXXXX",dir,JEM_SNAPSHOT_FILE);
+        int fd = tmp ? mkstemp(tmp) : -1;
+        if(fd>=0) {
+            ssize_t w = 0;
+            uint64_t written;
+            for(written=0;written<size && (w = write(fd,buf+written,size-written))>0;written+=w);
+            fchmod(fd,S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            close(fd);
+            asprintf(&path,"%s%s",dir,JEM_SNAPSHOT_FILE);
+            if(written!=size ||
+               !path ||
+               rename(tmp,path)!=0) {
+                unlink(tmp);
+                free(path);
+                path = NULL;
+            }
+        }
+        free(tmp);
+        free(buf);
+    } else
+        jemPrintError("Unable to allocate memory to hold index snapshot");
+    for(i=0;i<count;i++) {
+        free(entries[i].name);
+        free(entries[i].filename);
+        jemFreeParams(entries[i].params);
+    }
+    free(entries);
+    return(path);
+}
+
+/**
+ * Get the first cache directory the user may write to, creating it if needed
+ *
+ * @param dirs a null terminated array of cache directory names
+ * @return the index of the directory, or -1 if none
+ */
+static int jemSnapshotWritableDir(char **dirs) {
+    int i;
+    for(i=0;dirs[i];i++)
+        if(jemCacheMkdirs(dirs[i]) && access(dirs[i],W_OK)==0)
+            return(i);
+    return(-1);
+}
+
+/**
+ * Unmap the process wide index snapshot
+ */
+static void jemSnapshotUnmap(void) {
+    if(jem_snapshot_state>0) {
+        munmap(jem_snapshot.map,jem_snapshot.size);
+        free(jem_snapshot.checked);
+        jem_snapshot.checked = NULL;
+    }
+    jem_snapshot_state = 0;
+}
+
+/**
+ * Write a new snapshot to the first writable cache directory, the tree is
+ * scanned once and not at all if no directory is writable
+ *
+ * @return the snapshot file name, or null on error. The string must be freed!
+ */
+static char *jemSnapshotRebuild(void) {
+    char **dirs = jemCacheDirs();
+    int w = dirs ? jemSnapshotWritableDir(dirs) : -1;
+    char *path = w>=0 ? jemSnapshotWrite(dirs[w]) : NULL;
+    int i;
+    for(i=0;dirs && dirs[i];i++)
+        free(dirs[i]);
+    free(dirs);
+    return(path);
+}
+
+/**
+ * Get the process wide snapshot, mapping the newest valid snapshot from the
+ * cache directories, or writing a new one to the first writable directory if
+ * none is valid
+ *
+ * @return a pointer to the snapshot, or null if not available
+ */
+static struct jem_snapshot *jemSnapshotGet(void) {
+    if(jem_snapshot_state==0) {
+        jem_snapshot_state = -1;
+        char **dirs = jem_use_cache ? jemCacheDirs() : NULL;
+        char *paths[3] = { NULL, NULL, NULL };
+        struct jem_snapshot_stamp stamps[3];
+        int i;
+        for(i=0;dirs && dirs[i] && i<3;i++) {
+            asprintf(&paths[i],"%s%s",dirs[i],JEM_SNAPSHOT_FILE);
+            if(paths[i])
+                jemSnapshotStampFile(&stamps[i],paths[i]);
+        }
+        while(jem_snapshot_state<0) {   // newest first, a rebuild goes to the writable one
+            int newest = -1;
+            for(i=0;i<3;i++)
+                if(paths[i] && stamps[i].ino &&
+                   (newest<0 || stamps[i].mtime>stamps[newest].mtime ||
+                    (stamps[i].mtime==stamps[newest].mtime && stamps[i].mtime_nsec>stamps[newest].mtime_nsec)))
+                    newest = i;
+            if(newest<0)
+                break;
+            if(jemSnapshotMap(paths[newest]))
+                jem_snapshot_state = 1;
+            stamps[newest].ino = 0;
+        }
+        for(i=0;i<3;i++)
+            free(paths[i]);
+        int w = jem_snapshot_state<0 && dirs ? jemSnapshotWritableDir(dirs) : -1;
+        if(w>=0) {
+            char *path = jemSnapshotWrite(dirs[w]);
+            if(path && jemSnapshotMap(path))
+                jem_snapshot_state = 1;
+            free(path);
+        }
+        for(i=0;dirs && dirs[i];i++)
+            free(dirs[i]);
+        free(dirs);
+    }
+    if(jem_snapshot_state>0)
+        return(&jem_snapshot);
+    return(NULL);
+}
+
+/**
+ * Find the record of a file in the snapshot, checking the file's stamp the
+ * first time the record is used
+ *
+ * @param filename the absolute file name
+ * @return a pointer to the record, or null if not found or the file changed
+ */
+static const struct jem_snapshot_record *jemSnapshotFind(const char *filename) {
+    struct jem_snapshot *snap = jemSnapshotGet();
+    if(!snap)
+        return(NULL);
+    uint32_t b;
+    for(b=jemSnapshotHash(filename) & snap->header->mask;
+        snap->buckets[b];
+        b=(b+1) & snap->header->mask) {
+        uint32_t r = snap->buckets[b]-1;
+        const struct jem_snapshot_record *record = &snap->records[r];
+        if(strcmp(snap->strings+record->filename,filename))
+            continue;
+        if(!snap->checked[r])
+            snap->checked[r] = jemSnapshotStampMatches(&record->stamp,filename) ? 1 : -1;
+        if(snap->checked[r]>0)
+            return(record);
+        jem_snapshot_stale = true;  // the caller reads the file itself
+        return(NULL);
+    }
+    return(NULL);
+}
+
+/**
+ * Frees the process wide index snapshot, rebuilding it if a file in it was
+ * found changed
+ */
+void jemSnapshotClose(void) {
+    bool stale = jem_snapshot_state>0 && jem_snapshot_stale;
+    jemSnapshotUnmap();
+    jem_snapshot_stale = false;
+    if(stale)   // the next run maps a current snapshot
+        free(jemSnapshotRebuild());
+}
+
+/**
+ * Get the amount of records of a kind in the index snapshot
+ *
+ * @param kind the kind of records
+ * @return the amount of records, 0 if no valid snapshot is available
+ */
+unsigned int jemSnapshotCount(enum jem_snapshot_kind kind) {
+    struct jem_snapshot *snap = jemSnapshotGet();
+    if(!snap)
+        return(0);
+    return(snap->header->count[kind]);
+}
+
+/**
+ * Get the name of a record in the index snapshot, records of a kind are
+ * sorted by name
+ *
+ * @param kind the kind of records
+ * @param i the index of the record within its kind
+ * @return a string containing the value. The string must NOT be freed!
+ */
+const char *jemSnapshotName(enum jem_snapshot_kind kind,unsigned int i) {
+    struct jem_snapshot *snap = jemSnapshotGet();
+    return(snap->strings+snap->records[snap->header->first[kind]+i].name);
+}
+
+/**
+ * Check if a file exists, using the index snapshot if the file is in it.
+ * Missing release files are recorded with an empty stamp.
+ *
+ * @param filename the absolute file name
+ * @return true if the file exists, false otherwise
+ */
+bool jemSnapshotFileExists(const char *filename) {
+    const struct jem_snapshot_record *record = jemSnapshotFind(filename);
+    if(record)
+        return(record->stamp.ino!=0);
+    struct stat st;
+    return(stat(filename,&st)==0);
+}
+
+/**
+ * Get the parsed copy of a config/package.env file from the index snapshot
+ *
+ * @param filename the absolute file name
+ * @param params set to an array of param structs, or null if none. Which must
+ *        be freed using jemFreeParams(), struct members must NOT be freed!
+ * @return true if the file is in the snapshot, false otherwise
+ */
+bool jemSnapshotGetParams(const char *filename,struct jem_param **params) {
+    const struct jem_snapshot_record *record = jemSnapshotFind(filename);
+    *params = NULL;
+    if(!record)
+        return(false);
+    if(record->params)
+        *params = jemParamsUnpack((char *)jem_snapshot.map+record->params,record->params_size);
+    return(true);
+}
+
+/**
+ * Get the stamp a file had when its record in the index snapshot was written
+ *
+ * @param filename the absolute file name
+ * @param stamp pointer to a stamp struct to fill in
+ * @return true if the file is in the snapshot and unchanged, false otherwise
+ */
+bool jemSnapshotGetStamp(const char *filename,struct jem_snapshot_stamp *stamp) {
+    const struct jem_snapshot_record *record = jemSnapshotFind(filename);
+    if(!record)
+        return(false);
+    *stamp = record->stamp;
+    return(true);
+}
+
+/**
+ * Parses a config/package.env file, using the parsed copy in the index
+ * snapshot if the file is in it
+ *
+ * @param filename the absolute file name
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemSnapshotParseFile(const char *filename) {
+    struct jem_param *params;
+    if(!jemSnapshotGetParams(filename,&params))
+        params = jemParseFile(filename);
+    return(params);
+}
+
+/**
+ * Rebuild the index snapshot in the first writable cache directory
+ *
+ * @return true if the snapshot was written, false otherwise
+ */
+bool jemSnapshotUpdate(void) {
+    jemSnapshotUnmap();
+    jem_snapshot_stale = false;
+    char *path = jemSnapshotRebuild();
+    if(path && jemSnapshotMap(path))
+        jem_snapshot_state = 1;
+    free(path);
+    return(jem_snapshot_state>0);
+}
@@ -34,8 +34,37 @@
 #include <unistd.h>
 
 #include "../include/package.h"
+#include "../include/snapshot.h"
 #include "../include/vm.h"
 
+/**
+ * Entries of a VM's PATH directories, the first directory holding an
+ * executable of a name wins as in a shell PATH lookup
+ */
+struct jem_vm_tools {
+    char *paths;                /** copy of the PATH value, directories nul separated */
+    char **dirs;                /** directories, pointers into paths */
+    struct jem_param **names;   /** entry names of each directory as params, null if none */
+    unsigned int dir_count;     /** amount of directories */
+};
+
+/**
+ * Frees a tool table
+ *
+ * @param tools a pointer to a tool table, may be null
+ */
+static void jemFreeVmTools(struct jem_vm_tools *tools) {
+    if(!tools)
+        return;
+    unsigned int d;
+    for(d=0;d<tools->dir_count;d++)
+        jemFreeParams(tools->names[d]);
+    free(tools->paths);
+    free(tools->dirs);
+    free(tools->names);
+    free(tools);
+}
+
 /**
  * Frees the allocated memory used by an array of vm structs
  *
@@ -48,37 +77,157 @@ void jemFreeVMs(struct jem_vm *vms) {
     for(i=0;vms[i].filename;i++) {   // <- ugly, nasty, etc but works! :)
         free(vms[i].filename);
         jemFreeParams(vms[i].params);
+        jemFreeVmTools(vms[i].tools);
+        jemFreeParams(vms[i].release);
     }
     free(vms);
 }
 
 /**
- * Get the path to an executable by name
+ * Get the directories to look for executables of a VM in, its PATH, or
+ * JAVA_HOME/bin and JAVA_HOME/jre/bin if the VM config sets no PATH
  *
  * @param params an array of param structs
- * @param exec name of the executables path to get
- * @return a string containing the value. The string must be freed!
+ * @return a string containing colon separated directories, or null if none.
+ *         The string must be freed!
+ */
+char *jemVmGetToolPaths(struct jem_param *params) {
+    char *paths = NULL;
+    char *value = jemGetKey(params,JEM_KEY_PATH);
+    char *home = jemGetKey(params,JEM_KEY_JAVA_HOME);
+    if(value && *value)
+        paths = strdup(value);  // never split the stored value in place
+    else if(home)
+        asprintf(&paths,"%s/bin:%s/jre/bin",home,home);
+    return(paths);
+}
+
+/**
+ * Read the entry names of a directory into params, each name with an empty
+ * value, for a hashed lookup using jemGetValue(). Entries are not checked for
+ * being executable, that is left to the one looked up.
+ *
+ * @param dir the directory name
+ * @return an array of param structs, or null if none. Which must be freed
+ *         using jemFreeParams(), struct members must NOT be freed!
+ */
+struct jem_param *jemVmReadTools(const char *dir) {
+    int dirfd = open(dir,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if(dirfd<0)
+        return(NULL);
+    unsigned int count;
+    char **names = jemGetDirNames(dirfd,&count);
+    close(dirfd);
+    size_t len = 0;
+    unsigned int i;
+    for(i=0;names && i<count;i++)
+        len += strlen(names[i])+2;
+    char *buf = len ? malloc(len+1) : NULL;    // +1 for the nul of the last sprintf
+    struct jem_param *params = NULL;
+    if(buf) {
+        char *cursor = buf;
+        for(i=0;i<count;i++)
+            if(names[i][0]!='#' && !strpbrk(names[i],"=\n"))  // such names cannot be stored as params
+                cursor += sprintf(cursor,"%s=\n",names[i]);
+        params = jemParseBuffer(buf,cursor-buf);
+    } else if(len)
+        jemPrintError("Unable to allocate memory to hold VM executables"); // needs to clean up and exit under error, not just print a message
+    free(buf);
+    free(names);
+    return(params);
+}
+
+/**
+ * Read the entries of a VM's PATH directories into a tool table, from the
+ * index snapshot while a directory's stamp matches, otherwise one read of the
+ * directory
+ *
+ * @param params an array of param structs
+ * @return a pointer to a tool table, or null on error. Which must be freed
+ *         using jemFreeVmTools()!
  */
-char *jemVmGetExec(struct jem_param *params,const char *exec) {
-    char *paths = jemGetValue(params,"PATH");
-    char *path = NULL;
-    while((path = strsep(&paths,":"))) {
-        char *cmd;
-        asprintf(&cmd,"%s/%s",path,exec);
+static struct jem_vm_tools *jemVmLoadTools(struct jem_param *params) {
+    struct jem_vm_tools *tools = calloc(1,sizeof(struct jem_vm_tools));
+    if(!tools || !(tools->paths = jemVmGetToolPaths(params))) {
+        free(tools);
+        return(NULL);
+    }
+    unsigned int count = 1;
+    char *c;
+    for(c=tools->paths;*c;c++)
+        if(*c==':')
+            count++;
+    tools->dirs = calloc(count,sizeof(char *));
+    tools->names = calloc(count,sizeof(struct jem_param *));
+    if(!tools->dirs || !tools->names) {
+        jemPrintError("Unable to allocate memory to hold VM executables"); // needs to clean up and exit under error, not just print a message
+        jemFreeVmTools(tools);
+        return(NULL);
+    }
+    char *cursor = tools->paths;
+    char *dir;
+    while((dir = strsep(&cursor,":"))) {
+        if(!*dir)
+            continue;
+        unsigned int d = tools->dir_count++;
+        tools->dirs[d] = dir;
+        if(!jemSnapshotGetParams(dir,&tools->names[d]))
+            tools->names[d] = jemVmReadTools(dir);
+    }
+    return(tools);
+}
+
+/**
+ * Get the path to an executable of a VM by name. The entries of all PATH
+ * directories are read once into a table kept with the VM, from the index
+ * snapshot when the directories are in it. Only the entry returned is checked
+ * for being an executable file, if not the next directory holding the name is.
+ *
+ * @param vm a pointer to a vm struct
+ * @param tool name of the executable to get
+ * @return a string containing the value, or null if the VM does not have the
+ *         executable. The string must be freed!
+ */
+char *jemVmGetTool(struct jem_vm *vm,const char *tool) {
+    if(!vm->tools && !(vm->tools = jemVmLoadTools(vm->params)))
+        return(NULL);
+    unsigned int d;
+    for(d=0;d<vm->tools->dir_count;d++) {
+        if(!jemGetValue(vm->tools->names[d],tool))
+            continue;
+        char *cmd = NULL;
         struct stat st;
-        if(stat(cmd,&st)<0) {
-            free(cmd);
-            if(errno==EACCES)
-                jemPrintError("Java executable not readable"); // might need to be changed to throw an exception
-            else
-                jemPrintError("Invalid java executable, bad path or file name"); // might need to be changed to throw an exception
-            return(NULL);
-        }
-        return(cmd);
+        asprintf(&cmd,"%s/%s",vm->tools->dirs[d],tool);
+        if(cmd && stat(cmd,&st)==0 && S_ISREG(st.st_mode) && access(cmd,X_OK)==0)
+            return(cmd);
+        free(cmd);
     }
     return(NULL);
 }
 
+/**
+ * Get the parameters of a VM's JAVA_HOME/release file, such as JAVA_VERSION
+ * and IMPLEMENTOR. The file is parsed once and read from the index snapshot
+ * while its stamp matches.
+ *
+ * @param vm a pointer to a vm struct
+ * @return an array of param structs, or null if the VM has no release file.
+ *         Must NOT be freed!
+ */
+struct jem_param *jemVmGetRelease(struct jem_vm *vm) {
+    if(vm->release_loaded)
+        return(vm->release);
+    vm->release_loaded = true;
+    char *home = jemGetKey(vm->params,JEM_KEY_JAVA_HOME);
+    char *release = NULL;
+    if(home)
+        asprintf(&release,"%s/%s",home,JEM_VM_RELEASE);
+    if(release && jemSnapshotFileExists(release))
+        vm->release = jemSnapshotParseFile(release);
+    free(release);
+    return(vm->release);
+}
+
 /**
  * Get the name of the vm
  *
@@ -96,7 +245,7 @@ char *jemVmGetName(struct jem_vm *vm) {
  * @return a string containing the value. The string must NOT be freed!
  */
 char *jemVmGetProvidesType(struct jem_param *params) {
-    return(jemGetValue(params,"PROVIDES_TYPE"));
+    return(jemGetKey(params,JEM_KEY_PROVIDES_TYPE));
 }
 
 /**
@@ -106,7 +255,7 @@ char *jemVmGetProvidesType(struct jem_param *params) {
  * @return a string containing the value. The string must NOT be freed!
  */
 char *jemVmGetProvidesVersion(struct jem_param *params) {
-    return(jemGetValue(params,"PROVIDES_VERSION"));
+    return(jemGetKey(params,JEM_KEY_PROVIDES_VERSION));
 }
 
 /**
@@ -116,7 +265,7 @@ char *jemVmGetProvidesVersion(struct jem_param *params) {
  * @return a string containing the value. The string must NOT be freed!
  */
 char *jemVmGetVersion(struct jem_param *params) {
-    return(jemGetValue(params,"VERSION"));
+    return(jemGetKey(params,JEM_KEY_VERSION));
 }
 
 /**
@@ -125,7 +274,7 @@ char *jemVmGetVersion(struct jem_param *params) {
  * @return true if build only, false otherwise
  */
 bool jemVmIsBuildOnly(struct jem_param *params) {
-    char *v = jemGetValue(params,"BUILD_ONLY");
+    char *v = jemGetKey(params,JEM_KEY_BUILD_ONLY);
     if(v &&
        strcasecmp(v,"TRUE")==0)
         return(true);
@@ -141,6 +290,8 @@ bool jemVmIsBuildOnly(struct jem_param *params) {
 bool jemVmIsType(struct jem_param *params,const char *type) {
     bool is_type = false;
     char *types = jemVmGetProvidesType(params);
+    if(!types)
+        return(false);
     char *types_str = calloc(strlen(types)+1,sizeof(char));
     char *cursor = types_str;
     memcpy(cursor,types,strlen(types));
@@ -179,7 +330,7 @@ int jemVmProvides(struct jem_param *params,
         int b;
         for(a=0;vp[a];a++) {
             for(b=0;!provides && virtuals[b];b++)
-                if(strcasecmp(vp[a],virtuals[b]))
+                if(strcasecmp(vp[a],virtuals[b])==0)
                     provides++;
             free(vp[a]);
         }
@@ -250,9 +401,289 @@ char *jemVmGetUserVMLink(void) {
     return(user_vm);
 }
 
+/**
+ * A node of the case folded VM name trie
+ */
+struct jem_vm_trie_node {
+    int child;              /** first child node index, -1 if none */
+    int sibling;            /** next sibling node index, -1 if none */
+    int vm;                 /** index of the vm named by the path to this node, -1 if none */
+    int first;              /** index of the first vm named in this subtree */
+    unsigned int count;     /** amount of vms named in this subtree */
+    unsigned char c;        /** case folded character */
+};
+
+/**
+ * A path of a VM, its config file name or JAVA_HOME
+ */
+struct jem_vm_path {
+    const char *path;       /** the path, null if the hash slot is empty */
+    int vm;                 /** index of the vm */
+};
+
+/**
+ * Index of an array of vm structs, a case folded trie of the VM names for
+ * exact and prefix matches, and a hash of the config file names and
+ * JAVA_HOMEs
+ */
+struct jem_vm_index {
+    struct jem_vm *vms;                 /** the indexed vms */
+    unsigned int vm_count;              /** amount of vms */
+    struct jem_vm_trie_node *nodes;     /** trie nodes, the root first */
+    unsigned int node_count;            /** amount of nodes */
+    unsigned int node_size;             /** amount of nodes allocated */
+    struct jem_vm_path *paths;          /** open addressing hash table of paths */
+    size_t path_mask;                   /** path hash slots - 1 */
+};
+
+/**
+ * Frees a vm index
+ *
+ * @param index a pointer to a vm index, may be null
+ */
+void jemFreeVmIndex(struct jem_vm_index *index) {
+    if(!index)
+        return;
+    free(index->nodes);
+    free(index->paths);
+    free(index);
+}
+
+/**
+ * Case folded FNV-1a hash of a path
+ */
+static size_t jemVmHashPath(const char *path) {
+    uint32_t hash = 2166136261u;
+    for(;*path;path++)
+        hash = (hash ^ (unsigned char)tolower((unsigned char)*path)) * 16777619u;
+    return(hash);
+}
+
+/**
+ * Find the hash slot of a path in a vm index
+ *
+ * @param index a pointer to a vm index
+ * @param path the config file name or JAVA_HOME
+ * @return a pointer to the slot holding the path, or the empty slot
+ */
+static struct jem_vm_path *jemVmIndexFindPath(struct jem_vm_index *index,const char *path) {
+    size_t i = jemVmHashPath(path) & index->path_mask;
+    while(index->paths[i].path && strcasecmp(index->paths[i].path,path))
+        i = (i+1) & index->path_mask;
+    return(&index->paths[i]);
+}
+
+/**
+ * Find the child of a trie node for a character, adding it if requested
+ *
+ * @param index a pointer to a vm index
+ * @param node the parent node index
+ * @param c the case folded character
+ * @param add add the child if the node has none for the character
+ * @return the child node index, or -1 if none or out of memory
+ */
+static int jemVmTrieChild(struct jem_vm_index *index,int node,unsigned char c,bool add) {
+    int child;
+    for(child=index->nodes[node].child;child>=0;child=index->nodes[child].sibling)
+        if(index->nodes[child].c==c)
+            return(child);
+    if(!add)
+        return(-1);
+    if(index->node_count==index->node_size) {
+        unsigned int size = index->node_size*2;
+        struct jem_vm_trie_node *nodes = realloc(index->nodes,sizeof(struct jem_vm_trie_node)*size);
+        if(!nodes)
+            return(-1);
+        index->nodes = nodes;
+        index->node_size = size;
+    }
+    child = index->node_count++;
+    index->nodes[child].child = -1;
+    index->nodes[child].sibling = index->nodes[node].child;
+    index->nodes[child].vm = -1;
+    index->nodes[child].first = -1;
+    index->nodes[child].count = 0;
+    index->nodes[child].c = c;
+    index->nodes[node].child = child;
+    return(child);
+}
+
+/**
+ * Walk the trie of a vm index along a case folded name
+ *
+ * @param index a pointer to a vm index
+ * @param name the name or prefix of a VM
+ * @return the node index at the end of the name, or -1 if no VM name has
+ *         the prefix
+ */
+static int jemVmTrieWalk(struct jem_vm_index *index,const char *name) {
+    int node = 0;
+    for(;node>=0 && *name;name++)
+        node = jemVmTrieChild(index,node,tolower((unsigned char)*name),false);
+    return(node);
+}
+
+/**
+ * Build an index of an array of vm structs
+ *
+ * @param vms array of vm structs
+ * @param vm_count the amount of vms in the array
+ * @return a pointer to a vm index, or null if out of memory. Which must be
+ *         freed using jemFreeVmIndex()!
+ */
+struct jem_vm_index *jemVmIndexNew(struct jem_vm *vms,unsigned short vm_count) {
+    struct jem_vm_index *index = calloc(1,sizeof(struct jem_vm_index));
+    size_t size = 16;
+    while(size<(size_t)vm_count*4)  // file names and JAVA_HOMEs
+        size *= 2;
+    if(index) {
+        index->vms = vms;
+        index->vm_count = vm_count;
+        index->node_size = 64;
+        index->nodes = malloc(sizeof(struct jem_vm_trie_node)*index->node_size);
+        index->paths = calloc(size,sizeof(struct jem_vm_path));
+        index->path_mask = size-1;
+    }
+    if(!index || !index->nodes || !index->paths) {
+        jemPrintError("Unable to allocate memory to hold VM index"); // needs to clean up and exit under error, not just print a message
+        jemFreeVmIndex(index);
+        return(NULL);
+    }
+    index->node_count = 1;
+    memset(index->nodes,0,sizeof(struct jem_vm_trie_node));
+    index->nodes[0].child = -1;
+    index->nodes[0].sibling = -1;
+    index->nodes[0].vm = -1;
+    index->nodes[0].first = -1;
+    int i;
+    for(i=0;i<vm_count && vms[i].filename;i++) {
+        const char *path[] = { vms[i].filename, jemGetKey(vms[i].params,JEM_KEY_JAVA_HOME) };
+        unsigned int p;
+        for(p=0;p<sizeof(path)/sizeof(path[0]);p++) {
+            struct jem_vm_path *slot = path[p] ? jemVmIndexFindPath(index,path[p]) : NULL;
+            if(slot && !slot->path) {
+                slot->path = path[p];
+                slot->vm = i;
+            }
+        }
+        const char *name = jemVmGetName(&vms[i]);
+        int node = 0;
+        for(;node>=0;name++) {
+            if(!index->nodes[node].count++)
+                index->nodes[node].first = i;
+            if(!*name)
+                break;
+            node = jemVmTrieChild(index,node,tolower((unsigned char)*name),true);
+        }
+        if(node<0) {
+            jemPrintError("Unable to allocate memory to hold VM index"); // needs to clean up and exit under error, not just print a message
+            jemFreeVmIndex(index);
+            return(NULL);
+        }
+        if(index->nodes[node].vm<0)
+            index->nodes[node].vm = i;
+    }
+    return(index);
+}
+
+/**
+ * Collect the vms named in a trie subtree
+ *
+ * @param index a pointer to a vm index
+ * @param node the subtree root node index
+ * @param found array to store the vms in
+ * @param count pointer to the amount of vms stored
+ */
+static void jemVmTrieCollect(struct jem_vm_index *index,
+                             int node,
+                             struct jem_vm **found,
+                             unsigned int *count) {
+    if(index->nodes[node].vm>=0)
+        found[(*count)++] = &index->vms[index->nodes[node].vm];
+    int child;
+    for(child=index->nodes[node].child;child>=0;child=index->nodes[child].sibling)
+        jemVmTrieCollect(index,child,found,count);
+}
+
+/**
+ * Compares two vm pointers by their position in the vm array, used soley by
+ * qsort in jemVmIndexPrefixed()
+ *
+ * @return an integer -1, 0, or 1.
+ */
+static int jemVmComparePtrs(const void *v1, const void *v2) {
+    const struct jem_vm *vm1 = *(struct jem_vm * const *)v1;
+    const struct jem_vm *vm2 = *(struct jem_vm * const *)v2;
+    return((vm1>vm2)-(vm1<vm2));
+}
+
+/**
+ * Get the VMs whose names start with a prefix, case insensitive
+ *
+ * @param index a pointer to a vm index
+ * @param prefix the prefix of the VM names
+ * @return a null terminated array of vm pointers in vm array order, or null if
+ *         none. The array must be freed, but NOT the VM array elements!
+ */
+struct jem_vm **jemVmIndexPrefixed(struct jem_vm_index *index,const char *prefix) {
+    int node = index ? jemVmTrieWalk(index,prefix) : -1;
+    if(node<0 || !index->nodes[node].count)
+        return(NULL);
+    struct jem_vm **found = calloc(index->nodes[node].count+1,sizeof(struct jem_vm *));
+    if(!found) {
+        jemPrintError("Unable to allocate memory to hold VMs"); // needs to clean up and exit under error, not just print a message
+        return(NULL);
+    }
+    unsigned int count = 0;
+    jemVmTrieCollect(index,node,found,&count);
+    qsort(found,count,sizeof(struct jem_vm *),jemVmComparePtrs);
+    return(found);
+}
+
+/**
+ * Get a VM by number, config file name, JAVA_HOME, or VM name. A VM name
+ * matches exactly, or as the unique prefix of one VM's name, an ambiguous
+ * prefix is reported. Names are matched case insensitive.
+ *
+ * @param index a pointer to a vm index
+ * @param vm_name string containing the vm number, path or name
+ * @return a pointer to a vm struct, or null if not found. Must NOT be freed!
+ */
+struct jem_vm *jemVmIndexGet(struct jem_vm_index *index,const char *vm_name) {
+    if(!index || !vm_name || !*vm_name)
+        return(NULL);
+    if(!vm_name[strspn(vm_name,"0123456789")]) {    // number as listed by -L
+        unsigned long n = strtoul(vm_name,NULL,10);
+        return(n>=1 && n<=index->vm_count ? &index->vms[n-1] : NULL);
+    }
+    if(strchr(vm_name,'/')) {
+        struct jem_vm_path *slot = jemVmIndexFindPath(index,vm_name);
+        return(slot->path ? &index->vms[slot->vm] : NULL);
+    }
+    int node = jemVmTrieWalk(index,vm_name);
+    if(node<0)
+        return(NULL);
+    if(index->nodes[node].vm>=0)
+        return(&index->vms[index->nodes[node].vm]);
+    if(index->nodes[node].count==1)
+        return(&index->vms[index->nodes[node].first]);
+    struct jem_vm **found = jemVmIndexPrefixed(index,vm_name);
+    struct jem_str msg = { NULL, 0, 0 };
+    jemStrAppendf(&msg,"VM %s is ambiguous, it matches",vm_name);
+    int i;
+    for(i=0;found && found[i];i++)
+        jemStrAppendf(&msg," %s",jemVmGetName(found[i]));
+    if(msg.str)
+        jemPrintError(msg.str);
+    jemStrFree(&msg);
+    free(found);
+    return(NULL);
+}
+
 /**
  * Get a VM by index, filename, VM name including partial match, or JAVA_HOME
- * from an array of VM structs
+ * from an array of VM structs. Builds an index each call, use jemVmIndexGet()
+ * to look up several names.
  *
  * @param vms array of vm structs
  * @param vm_count the amount of vms in the array
@@ -262,37 +693,12 @@ char *jemVmGetUserVMLink(void) {
 struct jem_vm *jemVmGetVM(struct jem_vm *vms,
                           unsigned short *vm_count,
                           const char *vm_name) {
-    unsigned int i = vm_name[0];
     if(!vms)
         return(NULL);
-    if(strlen(vm_name)==1 &&
-       isdigit(i)) {
-        i = atoi(vm_name) - 1;
-        if(i<=*vm_count)
-            return(&vms[i]);
-        else
-            return (NULL);
-    }
-    if(strlen(vm_name)>=2) {
-        unsigned int b = vm_name[1];
-        if(isdigit(b)) {
-            char **end_ptr = NULL;
-            unsigned long l = strtol(vm_name,end_ptr,10) - 1;
-            if(i<=*vm_count)
-                return(&vms[l]);
-            else
-                return (NULL);
-        }
-    }
-    for(i=0;vms[i].filename;i++) {
-        if(strcasecmp(vm_name,vms[i].filename)==0)
-            return(&vms[i]);
-        if(strncasecmp(vm_name,jemVmGetName(&vms[i]),strlen(vm_name))==0)  // handles both full and partial matches
-            return(&vms[i]);
-        if(strcasecmp(vm_name,jemGetValue(vms[i].params,"JAVA_HOME"))==0)
-            return(&vms[i]);
-    }
-    return(NULL);
+    struct jem_vm_index *index = jemVmIndexNew(vms,*vm_count);
+    struct jem_vm *vm = jemVmIndexGet(index,vm_name);
+    jemFreeVmIndex(index);
+    return(vm);
 }
 
 /**
@@ -337,44 +743,82 @@ int jemVmCompareVMs(const void *v1, const void *v2) {
  * @return an array of vm structs. Which must be freed, including struct members!
  */
 struct jem_vm *jemVmLoadVMs(unsigned short *vm_count) {
-    DIR *dp;
     struct jem_vm *vms = NULL;
-    int i = 0;
-    if((dp = opendir(JEM_VMS_PATH))) {
-        struct dirent *file;
-        while((file = readdir(dp))) {
-            if(!strcmp(file->d_name,".") ||
-               !strcmp(file->d_name,".."))
-                continue;
-            struct jem_vm *nvms = realloc(vms,sizeof(struct jem_vm)*(i+2));
-            if(nvms) {
-                vms = nvms;
-                vms[i+1].filename = NULL;
-                vms[i+1].params = NULL;
-                asprintf(&(vms[i].filename),"%s/%s",JEM_VMS_PATH,file->d_name);
-                if(vms[i].filename)
-                    vms[i].params = jemParseFile(vms[i].filename);
-                else
-                    jemPrintError("Unable to allocate memory to hold VM config file name"); // needs to clean up and exit under error, not just print a message
-                
-                i++;
-            } else
-                jemPrintError("Unable to allocate memory to hold all VM config files"); // needs to clean up and exit under error, not just print a message
-        }
-    } else {
-        if(errno==EACCES)
+    char **names = NULL;
+    struct jem_io_file *files = NULL;
+    int dirfd = -1;
+    unsigned int i = 0;
+    unsigned int count = jemSnapshotCount(JEM_SNAPSHOT_VM);
+    if(!count) {
+        if((dirfd = open(JEM_VMS_PATH,O_RDONLY|O_DIRECTORY|O_CLOEXEC))>=0)
+            names = jemGetDirNames(dirfd,&count);
+        else if(errno==EACCES)
             jemPrintError("VMs config directory not readable"); // needs to be changed to throw an exception
         else
             jemPrintError("Invalid VMs configuration directory"); // needs to be changed to throw an exception
     }
-    if(vms)
-        qsort(vms,i+2,sizeof(struct jem_vm),jemVmCompareVMs);
-    if(dp)
-        closedir(dp);
+    if(count && !(vms = calloc(count+1,sizeof(struct jem_vm))))
+        jemPrintError("Unable to allocate memory to hold all VM config files"); // needs to clean up and exit under error, not just print a message
+    if(vms && names && (files = calloc(count,sizeof(struct jem_io_file)))) {
+        for(i=0;i<count;i++)
+            files[i].name = names[i];
+        jemIoReadFiles(dirfd,files,count);
+    }
+    for(i=0;vms && i<count;i++) {
+        const char *name = names ? names[i] : jemSnapshotName(JEM_SNAPSHOT_VM,i);
+        asprintf(&(vms[i].filename),"%s/%s",JEM_VMS_PATH,name);
+        if(!vms[i].filename)
+            jemPrintError("Unable to allocate memory to hold VM config file name"); // needs to clean up and exit under error, not just print a message
+        else if(files)
+            vms[i].params = jemIoParseFile(&files[i]);
+        else if(names)
+            vms[i].params = jemParseFileAt(dirfd,name);
+        else
+            vms[i].params = jemSnapshotParseFile(vms[i].filename);
+        vms[i].version = jemVersionKey(jemVmGetProvidesVersion(vms[i].params),NULL);
+    }
+    if(vms && names)
+        qsort(vms,i,sizeof(struct jem_vm),jemVmCompareVMs);
+    jemIoFreeFiles(files,count);
+    free(files);
+    free(names);
+    if(dirfd>=0)
+        close(dirfd);
     *vm_count = i;
     return(vms);
 }
 
+/**
+ * Loads a single installed VM config file, without loading the others. The
+ * file is read directly, the index snapshot is not used, validating it costs
+ * more than parsing one file.
+ *
+ * @param name the name of the VM config file in JEM_VMS_PATH
+ * @return an array of one vm struct, or null if not installed. Which must be
+ *         freed using jemFreeVMs()!
+ */
+struct jem_vm *jemVmLoadVM(const char *name) {
+    if(!*name || strchr(name,'/') || !strcmp(name,".") || !strcmp(name,".."))
+        return(NULL);
+    char *filename = NULL;
+    asprintf(&filename,"%s/%s",JEM_VMS_PATH,name);
+    struct stat st;
+    if(!filename || stat(filename,&st)!=0 || !S_ISREG(st.st_mode)) {
+        free(filename);
+        return(NULL);
+    }
+    struct jem_vm *vms = calloc(2,sizeof(struct jem_vm));
+    if(!vms) {
+        jemPrintError("Unable to allocate memory to hold VM config file"); // needs to clean up and exit under error, not just print a message
+        free(filename);
+        return(NULL);
+    }
+    vms[0].filename = filename;
+    vms[0].params = jemParseFile(filename);
+    vms[0].version = jemVersionKey(jemVmGetProvidesVersion(vms[0].params),NULL);
+    return(vms);
+}
+
 /**
  * Set the VM, create a symlink for the given vm to target
  *
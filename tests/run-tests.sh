@@ -63,6 +63,12 @@ test_jem() {
 
 	${VG} "${JEM}" -P "${VM}"
 	check_rc $?
+
+	ln -sf run-java-tool "${JEM%/*}/java"
+	${VG} "${JEM%/*}/java" -version
+	RC=$?
+	rm -f "${JEM%/*}/java"
+	check_rc ${RC}
 }
 
 case "$1" in
@@ -21,8 +21,11 @@
  *  along with jem.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <unistd.h>
 
+#include "../include/dep_closure.h"
 #include "../include/env_manager.h"
 
 char *jvm;
@@ -83,6 +86,26 @@ void testOutputFormatter() {
     fprintf(stdout,"void printWarning(const char *msg)\n");
     jemPrintWarning("Printing a warning that spans\na few lines so we get some\nline indenting\n");
 
+    fprintf(stdout,"\nstruct jem_str str; jemStrAppendSep(&str,\":\",...) x 400 ->\n");
+    struct jem_str str = { NULL, 0, 0 };
+    for(i=0;i<400;i++)
+        jemStrAppendSep(&str,":","/usr/share/pkg/lib/pkg.jar");
+    jemStrAppendf(&str,":%s-%d.jar","last",400);
+    fprintf(stdout,"len %zu, size %zu, tail %s\n",str.len,str.size,str.str+str.len-24);
+    jemStrFree(&str);
+
+    fprintf(stdout,"\nchar *jemAppendStrs(\"a\",\":\",NULL) ->\n");
+    char *astr = jemAppendStrs(strdup("a"),":",NULL);
+    astr = jemAppendStrs(astr,":","b");
+    fprintf(stdout,"%s\n",astr);
+    free(astr);
+
+    fprintf(stdout,"\nvoid jemStrDedup(\"a.jar:b.jar::a.jar:ab.jar:b.jar\",':') ->\n");
+    jemStrAppend(&str,"a.jar:b.jar::a.jar:ab.jar:b.jar");
+    jemStrDedup(&str,':');
+    fprintf(stdout,"%s, len %zu\n",str.str,str.len);
+    jemStrFree(&str);
+
 }
 
 void testFileParser() {
@@ -99,6 +122,8 @@ void testFileParser() {
 
     fprintf(stdout,"\ngetValue(params,\"BOOTCLASSPATH\") ->\n%s\n",jemGetValue(params,"BOOTCLASSPATH"));
 
+    fprintf(stdout,"\ngetKey(params,JEM_KEY_JAVA_HOME) ->\n%s\n",jemGetKey(params,JEM_KEY_JAVA_HOME));
+
     fprintf(stdout,"\nvoid freeParams(struct params *params)\n");
     jemFreeParams(params);
 
@@ -115,6 +140,51 @@ void testFileParser() {
     fprintf(stdout,"\nvoid freeParams(struct params *params)\n");
     jemFreeParams(params);
 
+    const char *buf = "# comment\nHOME=\"/opt/vm\"\nPATH=${HOME}/bin:${HOME}/jre/bin\n"
+                      "LIB=${NOPE}/lib:${HOME}/lib\nLAST=\"no newline\"";
+    fprintf(stdout,"\nparams = parseBuffer(buf,strlen(buf)); ->\n");
+    params = jemParseBuffer(buf,strlen(buf));
+    for(i=0;params[i].name;i++)
+        fprintf(stdout,"\tparams[%d]->name=%s\n\tparams[%d]->value=%s\n",i,params[i].name,i,params[i].value);
+    fprintf(stdout,"\nsize_t jemParamsCount(params) -> %zu\n",jemParamsCount(params));
+    jemFreeParams(params);
+
+    int dirfd = open(vm_conf_file,O_RDONLY|O_CLOEXEC);
+    fprintf(stdout,"\nparams = jemParseFd(fd); ->\n");
+    params = jemParseFd(dirfd);
+    fprintf(stdout,"\nsize_t jemParamsCount(params) -> %zu\n",jemParamsCount(params));
+    jemFreeParams(params);
+    close(dirfd);
+
+    unsigned int count;
+    dirfd = open(".",O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    fprintf(stdout,"\nchar **jemGetDirNames(dirfd,&count) ->\n");
+    char **names = jemGetDirNames(dirfd,&count);
+    for(i=0;names && names[i];i++)
+        if(!strcmp(names[i],"samples") || !strcmp(names[i],".."))
+            fprintf(stdout,"\t%s\n",names[i]);
+    fprintf(stdout,"count %s\n",names && count==(unsigned int)i ? "matches" : "differs");
+    free(names);
+
+    fprintf(stdout,"\nparams = jemParseFileAt(dirfd,\"%s\"); ->\n",pkg_env_file);
+    params = jemParseFileAt(dirfd,pkg_env_file);
+    fprintf(stdout,"\nsize_t jemParamsCount(params) -> %zu\n",jemParamsCount(params));
+    jemFreeParams(params);
+    close(dirfd);
+
+    struct jem_io_file files[2];
+    memset(files,0,sizeof(files));
+    files[0].name = vm_conf_file;
+    files[1].name = "/nonexistent";
+    fprintf(stdout,"\njemIoReadFiles(AT_FDCWD,files,2) -> io_uring %s\n",
+            jemIoAvailable() ? "available" : "not available");
+    jemIoReadFiles(AT_FDCWD,files,2);
+    params = jemIoParseFile(&files[0]);
+    fprintf(stdout,"size %zu, error %d, params %zu\n",files[0].size,files[0].error,jemParamsCount(params));
+    fprintf(stdout,"size %zu, error %d\n",files[1].size,files[1].error);
+    jemFreeParams(params);
+    jemIoFreeFiles(files,2);
+
 }
 
 void testPackage() {
@@ -153,11 +223,16 @@ void testPackage() {
     char **jars = jemPkgGetJarNames("ant-core");
     if(jars) {
         int i;
-        for(i=0;jars[i];i++) {
+        for(i=0;jars[i];i++)
             fprintf(stdout,"\t%s\n",jars[i]);
-            free(jars[i]);
-        }
-        free(jars);
+    }
+
+    fprintf(stdout,"\nconst char *jemPkgResolveName(const char *name) ->\n");
+    const char *resolve[] = { "asm", "asm:3", "asm-3", "qdox", "antlr", "antlr:0", "xom", "idontexist", NULL };
+    int r;
+    for(r=0;resolve[r];r++) {
+        const char *resolved = jemPkgResolveName(resolve[r]);
+        fprintf(stdout,"	%s = %s\n",resolve[r],resolved ? resolved : "null");
     }
 
     fprintf(stdout,"\nstruct dep *jemPkgGetBuildDeps(struct params *params) ->\n");
@@ -220,6 +295,39 @@ void testPackage() {
     fprintf(stdout,"%s\n",virtual);
     free(virtual);
 
+    fprintf(stdout,"\nconst struct jem_virtual *jemPkgGetVirtual(\"jaf\")->\n");
+    const struct jem_virtual *virt = jemPkgGetVirtual("jaf");
+    if(virt) {
+        int i;
+        fprintf(stdout,
+                "name = %s, has_file = %d, vm op = %d, vm version = %016llx\n",
+                virt->name,
+                virt->has_file,
+                virt->vm.op,
+                (unsigned long long)virt->vm.version);
+        for(i=0;virt->providers && virt->providers[i];i++)
+            fprintf(stdout,"\t%s\n",virt->providers[i]);
+    }
+
+    fprintf(stdout,"\nbool jemConstraintMatches(constraint,jemVersionKey(version,NULL))\n");
+    const char *constraints[] = { ">=virtual/jre-1.8", "<11", "=1.8", "icedtea-bin-7 oracle-jdk-bin-1.8", NULL };
+    const char *versions[] = { "1.7", "1.8.0_191", "9", "11", NULL };
+    int c;
+    for(c=0;constraints[c];c++) {
+        struct jem_constraint constraint;
+        jemConstraintParse(&constraint,constraints[c]);
+        int j;
+        for(j=0;versions[j];j++)
+            fprintf(stdout,
+                    "\t%s %s %s\n",
+                    versions[j],
+                    jemConstraintMatches(&constraint,jemVersionKey(versions[j],NULL)) ? "satisfies" : "does not satisfy",
+                    constraints[c]);
+    }
+
+    fprintf(stdout,"\nconst struct jem_virtual *jemPkgGetVirtual(\"ant-core\")->\n%s\n",
+            jemPkgGetVirtual("ant-core") ? "virtual" : "not a virtual");
+
 }
 
 void testVM() {
@@ -230,15 +338,23 @@ void testVM() {
     fprintf(stdout,"\nparams = parseFile(\"%s\");\n",vm_conf_file);
     params = jemParseFile(vm_conf_file);
 
-    fprintf(stdout,"\nchar *jemVmGetExec(params,\"javah\") ->\n");
-    char *exec;
-    if((exec = jemVmGetExec(params,"javah"))) {
-        fprintf(stdout,"exec = %s\n",exec);
-        free(exec);
-    }
-
-    fprintf(stdout,"\nchar *jemVmGetExec(params,\"your_momma\") ->\n");
-    jemVmGetExec(params,"your_momma");
+    fprintf(stdout,"\nstruct jem_vm *vms = jemVmLoadVM(\"%s\");\n",jvm);
+    struct jem_vm *vms = jemVmLoadVM(jvm);
+    if(vms) {
+        const char *tools[] = { "java", "javah", "jar", "your_momma", "java", NULL };
+        int t;
+        for(t=0;tools[t];t++) {
+            char *exec = jemVmGetTool(vms,tools[t]);
+            fprintf(stdout,"jemVmGetTool(vms,\"%s\") = %s\n",tools[t],exec ? exec : "null");
+            free(exec);
+        }
+        fprintf(stdout,"PATH = %s\n",jemGetKey(vms->params,JEM_KEY_PATH));
+        struct jem_param *release = jemVmGetRelease(vms);
+        fprintf(stdout,"jemGetValue(jemVmGetRelease(vms),\"JAVA_VERSION\") = %s\n",
+                jemGetValue(release,"JAVA_VERSION") ? jemGetValue(release,"JAVA_VERSION") : "null");
+        jemFreeVMs(vms);
+    } else
+        jemPrintError("^ Test failed!\nUnable to load VM");
 
 //    fprintf(stdout,"\nchar *jemVmGetName(struct vm *vm) ->\n%s\n",jemVmGetName(params));
 
@@ -281,6 +397,43 @@ void testVM() {
     jemFreeParams(params);
 }
 
+void testSnapshot() {
+    fprintf(stdout,"\nTesting snapshot.h functions\n");
+
+    fprintf(stdout,"\nbool jemSnapshotUpdate() ->\n%s\n",
+            jemSnapshotUpdate() ? "true" : "false");
+
+    fprintf(stdout,"\nunsigned int jemSnapshotCount(kind) ->\n");
+    fprintf(stdout,"packages %d, virtuals %d, vms %d\n",
+            jemSnapshotCount(JEM_SNAPSHOT_PKG),
+            jemSnapshotCount(JEM_SNAPSHOT_VIRTUAL),
+            jemSnapshotCount(JEM_SNAPSHOT_VM));
+    if(jemSnapshotCount(JEM_SNAPSHOT_VM))
+        fprintf(stdout,"first vm %s\n",jemSnapshotName(JEM_SNAPSHOT_VM,0));
+
+    fprintf(stdout,"\nparams = jemSnapshotParseFile(\"%s\");\n",pkg_env_file);
+    struct jem_param *params = jemSnapshotParseFile(pkg_env_file);
+    fprintf(stdout,"getKey(params,JEM_KEY_CLASSPATH) -> %s\n",jemGetKey(params,JEM_KEY_CLASSPATH));
+    jemFreeParams(params);
+
+    fprintf(stdout,"\nbool jemSnapshotFileExists(\"/nonexistent\") ->\n%s\n",
+            jemSnapshotFileExists("/nonexistent") ? "true" : "false");
+    jemSnapshotClose();
+
+    fprintf(stdout,"\nvoid jemClasspathCachePut(\"jem-test\",\"/jem-test.jar\",{\"%s\"},stamps)\n",pkg_env_file);
+    char *sources[] = { pkg_env_file, NULL };
+    struct jem_snapshot_stamp stamps[1];
+    jemSnapshotStampFile(&stamps[0],pkg_env_file);
+    jemClasspathCachePut("jem-test","/jem-test.jar",sources,stamps);
+    jemClasspathCacheClose();
+
+    fprintf(stdout,"\nchar *jemClasspathCacheGet(\"jem-test\") ->\n");
+    char *classpath = jemClasspathCacheGet("jem-test");
+    fprintf(stdout,"%s\n",classpath);
+    free(classpath);
+    jemClasspathCacheClose();
+}
+
 void testEnvManager() {
     fprintf(stdout,"\nTesting env_manager.h functions\n");
     int i;
@@ -296,6 +449,44 @@ void testEnvManager() {
         fprintf(stdout,"\tpkgs[%d]->name=%s\n",i,pkgs[i].name);
     }
 
+    fprintf(stdout,"\nclosure = jemDepClosureNew(pkgs,JEM_KEY_DEPEND);\n");
+    struct jem_dep_closure *closure = jemDepClosureNew(pkgs,JEM_KEY_DEPEND);
+    if(closure) {
+        fprintf(stdout,"\tpackages %zu, ids %zu, words %zu\n",closure->pkg_count,closure->count,closure->words);
+        long id = jemDepClosureId(closure,"xom");
+        struct jem_dep *deps = id<0 ? NULL : jemDepClosureDeps(closure,id);
+        for(i=0;deps && deps[i].name;i++) {
+            fprintf(stdout,"\tdeps[%d]->name=%s\n",i,deps[i].name);
+            jemFreeDep(&deps[i]);
+        }
+        free(deps);
+        long shared_id = jemDepClosureId(closure,"dom4j-1");
+        size_t ids[2] = { id, shared_id };
+        deps = id<0 || shared_id<0 ? NULL : jemDepClosureShared(closure,ids,2);
+        for(i=0;deps && deps[i].name;i++) {
+            fprintf(stdout,"\tshared[%d]->name=%s\n",i,deps[i].name);
+            jemFreeDep(&deps[i]);
+        }
+        free(deps);
+        jemFreeDepClosure(closure);
+    } else
+        jemPrintError("^ Test failed!\nUnable to build dependency closure");
+
+    fprintf(stdout,"\nclosure = jemDepClosureNewKeys(pkgs,keys,3);\n");
+    enum jem_key keys[] = { JEM_KEY_DEPEND, JEM_KEY_BUILD_DEPEND, JEM_KEY_OPTIONAL_DEPEND };
+    closure = jemDepClosureNewKeys(pkgs,keys,3);
+    if(closure) {
+        size_t ids[1] = { jemDepClosureId(closure,"oracle-javamail") };
+        struct jem_dep *deps = (long)ids[0]<0 ? NULL : jemDepClosureDependents(closure,ids,1,false);
+        for(i=0;deps && deps[i].name;i++) {
+            fprintf(stdout,"\tdependents[%d]->name=%s\n",i,deps[i].name);
+            jemFreeDep(&deps[i]);
+        }
+        free(deps);
+        jemFreeDepClosure(closure);
+    } else
+        jemPrintError("^ Test failed!\nUnable to build dependency closure");
+
     fprintf(stdout,"\nvoid freePkgs(struct pkg *pkgs)\n");
     jemFreePkgs(pkgs);
 
@@ -381,6 +572,16 @@ void testEnvManager() {
     else
         fprintf(stdout,"VM pointer is null\n");
 
+    fprintf(stdout,"\nindex = jemVmIndexNew(vms,vm_count);\n");
+    struct jem_vm_index *index = jemVmIndexNew(vms,vm_count);
+    const char *vm_names[] = { "openjdk", "ORACLEJDK-9", "oracle", "oraclejdk-1", "4", "5", NULL };
+    for(i=0;vm_names[i];i++) {
+        fflush(stdout); // keep ambiguity errors in order
+        vm = jemVmIndexGet(index,vm_names[i]);
+        fprintf(stdout,"jemVmIndexGet(index,\"%s\") = %s\n",vm_names[i],vm ? vm->filename : "null");
+    }
+    jemFreeVmIndex(index);
+
     fprintf(stdout,"\nvoid freeVMs(struct vm *vms)\n");
     jemFreeVMs(vms);
 
@@ -401,6 +602,20 @@ void testEnvManager() {
 
     fprintf(stdout,"\nvoid freeEnv(struct env *env)\n");
     jemFreeEnv(&env);
+
+    fprintf(stdout,"\nvm = jemSelectVM(\"xom\",false) ->\n");
+    vm = jemSelectVM("xom",false);
+    if(vm)
+        fprintf(stdout,"vm->filename=%s\n",vm->filename);
+    else
+        fprintf(stdout,"VM pointer is null\n");
+
+    fprintf(stdout,"\nvm = jemSelectVM(\"xom\",true) ->\n");
+    vm = jemSelectVM("xom",true);
+    if(vm)
+        fprintf(stdout,"vm->filename=%s\n",vm->filename);
+    else
+        fprintf(stdout,"VM pointer is null\n");
 /*
     fprintf(stdout,"\nstruct jem_vm *found = jemFindVM(\"%s\");\n",jvm);
     struct jem_vm **found = jemFindVM(jvm);
@@ -434,6 +649,7 @@ int main(int argc, char **argv) {
     testFileParser();
     testPackage();
     testVM();
+    testSnapshot();
     testEnvManager();
 
     fprintf(stdout,"\n\\********** Finished jem tests **********\\\n\n");